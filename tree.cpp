@@ -2,9 +2,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>    
+#include <string.h>
 #include <math.h>
 #include <time.h>
 #include <assert.h>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 // for timing CPU code : start
 #include <windows.h>
@@ -21,36 +26,263 @@ LARGE_INTEGER freq;
     }
 // for timing CPU code : end
 
+// Timeline tracing
+//
+// With ENABLE_TRACING the engines record begin/end events of their phases, and writeTrace() saves them in the
+// Chrome trace event format to be opened in chrome://tracing or ui.perfetto.dev. Every thread records into a
+// track of its own without locking; a track is handed to the next new thread when its thread exits, so the
+// workers of successive searches line up on the same tracks. Recursive searches only trace their root call.
+// Without ENABLE_TRACING the macros compile to nothing.
+
+#define ENABLE_TRACING 0
+
+#define TRACE_MAX_TRACKS 256
+#define TRACE_TRACK_EVENTS (1 << 20)    // per track, events past this are dropped
+
+#if ENABLE_TRACING
+
+struct TraceEvent
+{
+    const char *name;
+    long long ticks;
+    char phase;         // 'B'egin or 'E'nd
+};
+
+struct TraceTrack
+{
+    TraceEvent *events;
+    int nEvents;
+    int nDropped;
+    bool inUse;
+};
+
+TraceTrack gTraceTracks[TRACE_MAX_TRACKS];
+int gTraceNumTracks = 0;
+std::mutex gTraceLock;
+LARGE_INTEGER gTraceStart;
+
+struct TraceThread
+{
+    TraceTrack *track;
+
+    TraceThread() : track(NULL) {}
+    ~TraceThread()
+    {
+        std::lock_guard<std::mutex> guard(gTraceLock);
+        if (track)
+            track->inUse = false;
+    }
+};
+
+thread_local TraceThread gTraceThread;
+
+TraceTrack *traceTrack()
+{
+    if (gTraceThread.track)
+        return gTraceThread.track;
+
+    std::lock_guard<std::mutex> guard(gTraceLock);
+    if (gTraceNumTracks == 0)
+        QueryPerformanceCounter(&gTraceStart);
+
+    int t = 0;
+    while (t < gTraceNumTracks && gTraceTracks[t].inUse)
+        t++;
+    if (t == TRACE_MAX_TRACKS)
+        return NULL;
+    if (t == gTraceNumTracks)
+    {
+        gTraceTracks[t].events = (TraceEvent *) malloc(TRACE_TRACK_EVENTS * sizeof(TraceEvent));
+        gTraceNumTracks++;
+    }
+
+    gTraceTracks[t].inUse = true;
+    return gTraceThread.track = &gTraceTracks[t];
+}
+
+inline void traceEvent(const char *name, char phase)
+{
+    TraceTrack *track = traceTrack();
+    if (!track)
+        return;
+    if (track->nEvents == TRACE_TRACK_EVENTS)
+    {
+        track->nDropped++;
+        return;
+    }
+
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    TraceEvent *event = &track->events[track->nEvents++];
+    event->name = name;
+    event->ticks = now.QuadPart;
+    event->phase = phase;
+}
+
+struct TraceScope
+{
+    const char *name;   // NULL if not traced
+
+    TraceScope(const char *scopeName, bool active) : name(active ? scopeName : NULL)
+    {
+        if (name)
+            traceEvent(name, 'B');
+    }
+    ~TraceScope()
+    {
+        if (name)
+            traceEvent(name, 'E');
+    }
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name, true)
+#define TRACE_SCOPE_IF(cond, name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name, cond)
+#define TRACE_BEGIN(name) traceEvent(name, 'B')
+#define TRACE_END(name) traceEvent(name, 'E')
+
+// to be called when no other thread is recording
+void writeTrace(const char *fileName)
+{
+    FILE *fp = fopen(fileName, "w");
+    if (!fp)
+        return;
+
+    LARGE_INTEGER ticksPerSecond;
+    QueryPerformanceFrequency(&ticksPerSecond);
+    int pid = GetCurrentProcessId();
+    int nEvents = 0, nDropped = 0;
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+    for (int t = 0; t < gTraceNumTracks; t++)
+    {
+        fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+                t ? ",\n" : "", pid, t, t ? "thread" : "main", t);
+
+        TraceTrack *track = &gTraceTracks[t];
+        for (int i = 0; i < track->nEvents; i++)
+        {
+            TraceEvent *event = &track->events[i];
+            double us = ((double)(event->ticks - gTraceStart.QuadPart) * 1000000.0) / ticksPerSecond.QuadPart;
+            fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d}", event->name, event->phase, us, pid, t);
+        }
+        nEvents += track->nEvents;
+        nDropped += track->nDropped;
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+
+    printf("trace of %d events on %d threads written to %s (%d dropped)\n", nEvents, gTraceNumTracks, fileName, nDropped);
+}
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_SCOPE_IF(cond, name)
+#define TRACE_BEGIN(name)
+#define TRACE_END(name)
+
+void writeTrace(const char *) {}
+
+#endif
+
 //#define MAX_CHILDREN 40
 #define MAX_CHILDREN 12
+
+// The child counters in Node are 8 bit, so a node has at most 255 children. WIDE_TREES makes them 16 bit
+// for branching factors in the hundreds to thousands (wide games), at 8 more bytes per node
+#define WIDE_TREES 0
+
+#if WIDE_TREES
+typedef unsigned short ChildIndex;
+#else
+typedef unsigned char ChildIndex;
+#endif
+#define MAX_BRANCHING ((int) (ChildIndex) ~0)
+
+int gMaxChildren = MAX_CHILDREN;    // genTree() gives every interior node 1 to gMaxChildren children
+
+// Scores are 0..100 with two decimals. With INT_SCORES they are kept as int16 hundredths instead of floats:
+// half the storage in the nodes and the frontier arrays, twice the SIMD lanes in the frontier scans and
+// exact comparisons between the engines' results.
+#define INT_SCORES 0
+
+#if INT_SCORES
+typedef short Score;
+#define INF 10000
+#define SCORE_SCALE 100.0f
+#else
+typedef float Score;
 #define INF 10000.0f
+#define SCORE_SCALE 1.0f
+#endif
+
+#define scoreFromHundredths(h) ((Score) ((h) * SCORE_SCALE / 100.0f))
+#define scoreToFloat(s) ((float) (s) / SCORE_SCALE)     // for printing
 const int g_depth = 10;
 
 #define MAX_DEPTH 20
 
+#define MAX_THREADS 64
+int g_numThreads = 1;       // worker threads used by the parallel searches (set in main)
+#define MAX_NUMA_NODES 16
+
 
 #define PV_NODE  1
 #define CUT_NODE 2
 #define ALL_NODE 3
 
+#define BOUND_NONE  0
+#define BOUND_EXACT 1
+#define BOUND_LOWER 2
+#define BOUND_UPPER 3
+
+// Nodes hold what genTree() makes: the links and the leaf values. Searches only read them, everything they
+// record about a node goes in its NodeState (see below)
 struct Node
 {
-    float nodeVal;      // value from eval function for leaves, best searched value for interior nodes
+    Score nodeVal;      // value from eval function (leaves only)
     Node *children;     // pointer to array containing all child nodes
     Node *parent;       // pointer to parent node
+
+    ChildIndex    nChildren;       // no of child nodes
+    bool          isMaxNode;       // totally redundant, kept here for simplicity.
+    int           id;              // index of the node's NodeState, the order genTree() made the nodes in
+};
+
+// Search state
+//
+// What a search records about a node: its value, best child, how far it got and the bookkeeping of
+// exploreTree() and the incremental search. Each search works on an array of these indexed by Node::id, so the
+// tree itself is never written while searching: any number of searches (on as many threads) can run on the same
+// tree, each with a state of its own, and none of them sees what the others left behind. The engines use the
+// state of the calling thread, gNodeStates, and so do their worker threads (see searchThread()). All zero is the
+// state of a node no search has been to yet, as genTree() used to leave the nodes, and calloc only maps the pages
+// a search touches.
+struct NodeState
+{
+    Score nodeVal;      // best searched value (interior nodes)
     Node *best;         // pointer to best child
 
-    unsigned char nChildren;       // no of child nodes
-    unsigned char bestChild;       // most promising child/branch from this node
+    ChildIndex    bestChild;       // most promising child/branch from this node
+    ChildIndex    nChildsExplored; // num of chlidren explored (only valid for CUT nodes), alphabeta() sets it too
     unsigned char nodeType;        // PV, CUT or ALL node
-    unsigned char nChildsExplored; // num of chlidren explored (only valid for CUT nodes)
 
-    bool          isMaxNode;            // totally redundant, kept here for simplicity.
+    bool          dirty;                // a leaf below was changed by updateLeafValue() since the last incremental search
+    unsigned char searchBound;          // what nodeVal is after an incremental search: BOUND_NONE, _EXACT, _LOWER, _UPPER
     int           frontierOffset;       // offset of first leaf in the frontier of the subtree whose root is this node
-    int           numChildrenAtFrontier;// no of children of the subtree at frontier
+    int           numChildrenAtFrontier;// no of children of the subtree at frontier, 0 if frontierOffset isn't set
 };
 
-int gTotalNodes;
+thread_local NodeState *gNodeStates = NULL;
+
+inline NodeState *nodeState(const Node *node)
+{
+    return &gNodeStates[node->id];
+}
+
+int gTotalNodes;    // the nodes are numbered with it, all ids of a tree are below it once it's made
 int gLeafNodes;
 
 void freeTree(Node *root)
@@ -64,13 +296,256 @@ void freeTree(Node *root)
     free(root->children);
 }
 
-void genTree(Node *root, int depth)
+// gives the calling thread a new (all zero) state for the nodes made so far, freeing the one it had
+void newSearchState()
+{
+    free(gNodeStates);
+    gNodeStates = (NodeState *) calloc(gTotalNodes, sizeof(NodeState));
+}
+
+// std::thread(function, args...) searching with the state of the calling thread
+template <typename Function, typename... Args>
+std::thread searchThread(Function function, Args... args)
+{
+    NodeState *states = gNodeStates;
+    return std::thread([=] { gNodeStates = states; function(args...); });
+}
+
+
+// Leaf evaluation cost
+//
+// A leaf's value is a load from the node, so engines that evaluate more leaves with less bookkeeping per node
+// look better here than where the evaluation function dominates. LEAF_COST_MODEL adds a synthetic cost to
+// every leaf evaluation (evaluateLeaf()): LEAF_COST_SPIN spins through a chain of LEAF_COST_AMOUNT dependent
+// integer hashes (CPU bound), LEAF_COST_MEMORY makes LEAF_COST_AMOUNT dependent random reads in a table far
+// larger than the caches (memory bound). Either starts from the leaf's id, so the same leaf always costs the
+// same, and the result only goes to a sink: the values the engines see don't change. main() sets up the
+// configured model with setLeafCost(), which can change it at run time too.
+
+#define LEAF_COST_NONE   0
+#define LEAF_COST_SPIN   1
+#define LEAF_COST_MEMORY 2
+
+#define LEAF_COST_MODEL  LEAF_COST_NONE
+#define LEAF_COST_AMOUNT 100                    // hashes or reads per leaf
+#define LEAF_COST_TABLE_ENTRIES (1 << 24)       // 64 MB
+
+int gLeafCostModel = LEAF_COST_NONE;
+int gLeafCostAmount = 0;
+unsigned *gLeafCostTable = NULL;                // a single random cycle through all entries
+thread_local volatile unsigned gLeafCostSink;
+
+void setLeafCost(int model, int amount)
+{
+    gLeafCostModel = model;
+    gLeafCostAmount = amount;
+    if (model != LEAF_COST_MEMORY || gLeafCostTable)
+        return;
+
+    // Sattolo's shuffle, with a generator of its own to leave rand()'s sequence to genTree()
+    gLeafCostTable = (unsigned *) malloc(LEAF_COST_TABLE_ENTRIES * sizeof(unsigned));
+    for (unsigned i = 0; i < LEAF_COST_TABLE_ENTRIES; i++)
+        gLeafCostTable[i] = i;
+
+    unsigned long long rng = 88172645463325252ull;
+    for (unsigned i = LEAF_COST_TABLE_ENTRIES - 1; i > 0; i--)
+    {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        unsigned j = (unsigned) (rng % i);
+        unsigned t = gLeafCostTable[i];
+        gLeafCostTable[i] = gLeafCostTable[j];
+        gLeafCostTable[j] = t;
+    }
+}
+
+void leafCostWork(unsigned seed)
+{
+    unsigned x = seed;
+    if (gLeafCostModel == LEAF_COST_SPIN)
+    {
+        for (int i = 0; i < gLeafCostAmount; i++)
+            x = (x ^ (x >> 15)) * 2654435761u + i;
+    }
+    else
+    {
+        x &= LEAF_COST_TABLE_ENTRIES - 1;
+        for (int i = 0; i < gLeafCostAmount; i++)
+            x = gLeafCostTable[x];
+    }
+    gLeafCostSink = x;
+}
+
+inline void payLeafCost(unsigned seed)
+{
+    if (gLeafCostModel != LEAF_COST_NONE)
+        leafCostWork(seed);
+}
+
+// the value of a leaf, at the cost of the cost model
+inline Score evaluateLeaf(const Node *leaf)
+{
+    payLeafCost(leaf->id);
+    return leaf->nodeVal;
+}
+
+
+// Tree placement
+//
+// genTree() takes every children array from malloc on one thread, so the whole tree ends up on one NUMA
+// node in 4KB pages. genTreePlaced() builds the same tree (same rand() sequence) from per NUMA node arenas,
+// optionally backed by large (2MB) pages, with the subtree of root child i on NUMA node i % nNodes. That is
+// where parallelAlphabeta() searches it when given the number of NUMA nodes: worker t runs on node
+// t % nNodes and takes the root children placed on its own node first.
+
+#define PLACE_LARGE_PAGES 1
+#define PLACE_NUMA        2
+
+#define ARENA_CHUNK_SIZE (64 * 1024 * 1024)
+
+struct ArenaChunk
+{
+    ArenaChunk *next;
+    size_t size;
+};
+
+struct TreeArena
+{
+    ArenaChunk *chunks;     // allocated chunks, the header sits at the start of each
+    char  *cur;             // free space in the current chunk
+    size_t left;
+    int    numaNode;        // -1: no preference
+    bool   largePages;      // cleared if large pages can't be had
+};
+
+struct TreePlacement
+{
+    TreeArena arenas[MAX_NUMA_NODES];
+    int nNodes;
+    int flags;
+};
+
+TreeArena *gArena = NULL;   // genTree() allocates from here if set, malloc otherwise
+
+// large pages need SeLockMemoryPrivilege, which has to be granted to the user and then enabled
+bool enableLargePages()
+{
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+        return false;
+
+    TOKEN_PRIVILEGES tp;
+    tp.PrivilegeCount = 1;
+    tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    bool ok = LookupPrivilegeValueA(NULL, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid) &&
+              AdjustTokenPrivileges(token, FALSE, &tp, 0, NULL, NULL) &&
+              GetLastError() == ERROR_SUCCESS;
+
+    CloseHandle(token);
+    return ok;
+}
+
+void *allocArenaChunk(TreeArena *arena, size_t size)
+{
+    while (true)
+    {
+        DWORD type = MEM_RESERVE | MEM_COMMIT;
+        size_t allocSize = size;
+        if (arena->largePages)
+        {
+            size_t largePage = GetLargePageMinimum();
+            allocSize = (size + largePage - 1) / largePage * largePage;
+            type |= MEM_LARGE_PAGES;
+        }
+
+        void *mem;
+        if (arena->numaNode >= 0)
+            mem = VirtualAllocExNuma(GetCurrentProcess(), NULL, allocSize, type, PAGE_READWRITE, arena->numaNode);
+        else
+            mem = VirtualAlloc(NULL, allocSize, type, PAGE_READWRITE);
+
+        if (mem)
+        {
+            ArenaChunk *chunk = (ArenaChunk *) mem;
+            chunk->next = arena->chunks;
+            chunk->size = allocSize;
+            arena->chunks = chunk;
+            return mem;
+        }
+
+        // no privilege or not enough contiguous physical memory, fall back to small pages
+        if (!arena->largePages)
+            return NULL;
+        arena->largePages = false;
+    }
+}
+
+void *arenaAlloc(TreeArena *arena, size_t size)
+{
+    size = (size + 15) & ~(size_t) 15;
+    if (size > arena->left)
+    {
+        char *chunk = (char *) allocArenaChunk(arena, ARENA_CHUNK_SIZE);
+        assert(chunk);
+        arena->cur = chunk + sizeof(ArenaChunk);
+        arena->left = ARENA_CHUNK_SIZE - sizeof(ArenaChunk);
+    }
+
+    void *mem = arena->cur;
+    arena->cur += size;
+    arena->left -= size;
+    return mem;
+}
+
+void initTreePlacement(TreePlacement *placement, int flags)
+{
+    memset(placement, 0, sizeof(TreePlacement));
+    placement->flags = flags;
+    placement->nNodes = 1;
+
+    if (flags & PLACE_NUMA)
+    {
+        ULONG highest = 0;
+        if (GetNumaHighestNodeNumber(&highest))
+            placement->nNodes = min((int) highest + 1, MAX_NUMA_NODES);
+    }
+
+    bool largePages = (flags & PLACE_LARGE_PAGES) && enableLargePages();
+    for (int n = 0; n < placement->nNodes; n++)
+    {
+        placement->arenas[n].numaNode = (flags & PLACE_NUMA) ? n : -1;
+        placement->arenas[n].largePages = largePages;
+    }
+}
+
+// releases the memory of a tree built by genTreePlaced() (instead of freeTree())
+void freeTreePlacement(TreePlacement *placement)
 {
-    gTotalNodes++;
+    for (int n = 0; n < placement->nNodes; n++)
+    {
+        ArenaChunk *chunk = placement->arenas[n].chunks;
+        while (chunk)
+        {
+            ArenaChunk *next = chunk->next;
+            VirtualFree(chunk, 0, MEM_RELEASE);
+            chunk = next;
+        }
+    }
+    memset(placement->arenas, 0, sizeof(placement->arenas));
+}
 
-    root->frontierOffset = -1;
-    root->numChildrenAtFrontier = 0;
+void bindThreadToNumaNode(int node)
+{
+    GROUP_AFFINITY affinity;
+    if (GetNumaNodeProcessorMaskEx((USHORT) node, &affinity))
+        SetThreadGroupAffinity(GetCurrentThread(), &affinity, NULL);
+}
 
+void genTree(Node *root, int depth)
+{
+    TRACE_SCOPE_IF(depth == g_depth, "genTree");
+    root->id = gTotalNodes++;
 
     if (g_depth % 2 == 0)
     {
@@ -86,50 +561,81 @@ void genTree(Node *root, int depth)
     {
         gLeafNodes++;
         // generate random node val (between 0 and 100) and return
-        root->nodeVal = (rand() % 10000) / 100.0f;
+        root->nodeVal = scoreFromHundredths(rand() % 10000);
         return;
     }
 
     // allocate memory for random number of children (have at least one children for now - to be changed later!)
-    int nChildren = rand() % MAX_CHILDREN + 1;
+    int nChildren = rand() % gMaxChildren + 1;
+
+    Node *children = gArena ? (Node *) arenaAlloc(gArena, nChildren * sizeof(Node))
+                            : (Node *) malloc (nChildren * sizeof(Node));
+
+    for (int i=0; i<nChildren; i++)
+    {
+        children[i].nChildren = 0;
+        children[i].children = NULL;
+        children[i].nodeVal = 0;
+        children[i].parent = root;
+
+        genTree (&children[i], depth - 1);
+    }
+
+    root->nChildren = nChildren;
+    root->children = children;
+}
+
+// same tree as genTree() (depth must be > 0), with the memory coming from the placement's arenas
+void genTreePlaced(Node *root, int depth, TreePlacement *placement)
+{
+    TRACE_SCOPE("genTreePlaced");
+    root->id = gTotalNodes++;
+
+    if (g_depth % 2 == 0)
+        root->isMaxNode = !(depth % 2);
+    else
+        root->isMaxNode = !!(depth % 2);
 
-    Node *children = (Node *) malloc (nChildren * sizeof(Node));
+    int nChildren = rand() % gMaxChildren + 1;
+
+    Node *children = (Node *) arenaAlloc(&placement->arenas[0], nChildren * sizeof(Node));
 
     for (int i=0; i<nChildren; i++)
     {
-        children[i].nChildsExplored = 0;
         children[i].nChildren = 0;
         children[i].children = NULL;
-        children[i].nodeVal = 0.0f;
+        children[i].nodeVal = 0;
         children[i].parent = root;
 
+        gArena = &placement->arenas[i % placement->nNodes];
         genTree (&children[i], depth - 1);
     }
+    gArena = NULL;
 
     root->nChildren = nChildren;
     root->children = children;
-    root->nChildsExplored = 0;
 }
 
 
-float negaMax(Node *node, int depth, int origDepth)
+Score negaMax(Node *node, int depth, int origDepth)
 {
+    TRACE_SCOPE_IF(depth == origDepth, "negaMax");
     if (depth == 0)
     {
         // eval for even depths, -eval for odd depths
         if (origDepth % 2 == 0)
-            return node->nodeVal;
+            return evaluateLeaf(node);
         else
-            return -node->nodeVal;
+            return -evaluateLeaf(node);
     }
 
     // choose the best child
-    float bestScore = -INF;
+    Score bestScore = -INF;
     int bestChild = 0;
 
     for (int i = 0; i < node->nChildren; i++)
     {
-        float curScore = -negaMax(&node->children[i], depth - 1, origDepth);
+        Score curScore = -negaMax(&node->children[i], depth - 1, origDepth);
         if (curScore > bestScore)
         {
             bestScore = curScore;
@@ -137,969 +643,5544 @@ float negaMax(Node *node, int depth, int origDepth)
         }
     }
 
-    node->nodeVal = bestScore;
-    node->bestChild = bestChild;
+    nodeState(node)->nodeVal = bestScore;
+    nodeState(node)->bestChild = bestChild;
 
     return bestScore;
 }
 
+// Worker pool
+//
+// exploreTree() runs several frontier scans per pass of its main loop, each a few short parallel steps, too
+// short to start and join threads for every one of them. A pool keeps nThreads - 1 threads waiting for work
+// for as long as the search runs, searching with the state of the thread that made it (see searchThread()),
+// and that thread takes part in every job as thread 0.
 
+struct WorkerPool
+{
+    int nThreads;                       // including the thread that made it
+    std::thread threads[MAX_THREADS];
+    std::mutex lock;
+    std::condition_variable start;      // a new job, or quit
+    std::condition_variable done;       // the pool's threads are through with the job
+    unsigned job;                       // counts the jobs
+    int nActive;                        // threads the job runs on
+    int running;                        // pool threads still on the job
+    void (*function)(void *, int);
+    void *arg;
+    bool quit;
+};
 
-int gInteriorNodesVisited = 0;
-int gLeafNodesVisited = 0;
-
-float alphabeta(Node *node, int depth, int origDepth, float alpha, float beta)
+void poolThread(WorkerPool *pool, int t)
 {
-    if (depth == 0)
+    unsigned seen = 0;
+    for (;;)
     {
-        gLeafNodesVisited++;
+        void (*function)(void *, int);
+        void *arg;
+        {
+            std::unique_lock<std::mutex> guard(pool->lock);
+            pool->start.wait(guard, [&] { return pool->quit || pool->job != seen; });
+            if (pool->quit)
+                return;
+            seen = pool->job;
+            if (t >= pool->nActive)
+                continue;
+            function = pool->function;
+            arg = pool->arg;
+        }
 
-        // eval for even depths, -eval for odd depths
-        if (origDepth % 2 == 0)
-            return node->nodeVal;
-        else
-            return -node->nodeVal;
-    }
+        function(arg, t);
 
-    gInteriorNodesVisited++;
+        std::lock_guard<std::mutex> guard(pool->lock);
+        if (--pool->running == 0)
+            pool->done.notify_one();
+    }
+}
 
-    // choose the best child
-    int bestChild = 0;
+WorkerPool *createWorkerPool(int nThreads)
+{
+    WorkerPool *pool = new WorkerPool();
+    pool->nThreads = max(1, min(nThreads, MAX_THREADS));
+    pool->job = 0;
+    pool->nActive = pool->running = 0;
+    pool->quit = false;
+    for (int t = 1; t < pool->nThreads; t++)
+        pool->threads[t] = searchThread(poolThread, pool, t);
+    return pool;
+}
 
-    for (int i = 0; i < node->nChildren; i++)
+void destroyWorkerPool(WorkerPool *pool)
+{
     {
-        float curScore = -alphabeta(&node->children[i], depth - 1, origDepth, -beta, -alpha);
-        if (curScore >= beta)
-        {
-            return beta;
-        }
+        std::lock_guard<std::mutex> guard(pool->lock);
+        pool->quit = true;
+    }
+    pool->start.notify_all();
+    for (int t = 1; t < pool->nThreads; t++)
+        pool->threads[t].join();
+    delete pool;
+}
 
-        if (curScore > alpha)
-        {
-            alpha = curScore;
-            bestChild = i;
-        }
+// function(arg, t) on threads t = 0 .. nActive - 1 of the pool (nActive at most its nThreads), returns when
+// all of them are done
+void runPoolJob(WorkerPool *pool, int nActive, void (*function)(void *, int), void *arg)
+{
+    assert(nActive <= pool->nThreads);
+    if (nActive <= 1)
+    {
+        function(arg, 0);
+        return;
     }
 
-    node->nodeVal = alpha;
-    node->bestChild = bestChild;
+    {
+        std::lock_guard<std::mutex> guard(pool->lock);
+        pool->function = function;
+        pool->arg = arg;
+        pool->nActive = nActive;
+        pool->running = nActive - 1;
+        pool->job++;
+    }
+    pool->start.notify_all();
 
-    return alpha;
+    function(arg, 0);
 
+    std::unique_lock<std::mutex> guard(pool->lock);
+    pool->done.wait(guard, [&] { return pool->running == 0; });
 }
 
-bool isBetter(Node *node, float val)
+template <typename Function>
+void callPoolFunction(void *function, int t)
 {
-    if (node->isMaxNode && val > node->nodeVal)
-        return true;
-
-    if ((!node->isMaxNode) && (val < node->nodeVal))
-        return true;
-
-    return false;
+    (*(Function *) function)(t);
 }
 
-// returns true if val1 is better than val2
-bool isBetter(bool isMaxNode, float val1, float val2)
+// function(t) on threads t = 0 .. nActive - 1 of the pool
+template <typename Function>
+void runOnPool(WorkerPool *pool, int nActive, Function function)
 {
-    if (isMaxNode && (val1 > val2))
-        return true;
-
-    if ((!isMaxNode) && (val1 < val2))
-        return true;
-
-    return false;
+    runPoolJob(pool, nActive, callPoolFunction<Function>, &function);
 }
 
-int propogateFrontierOffsets(Node *node, int *childrenAtFrontier)
+// body(block, begin, end) for nBlocks equal blocks of [0, n), on the threads of the pool
+template <typename Body>
+void parallelBlocks(WorkerPool *pool, int n, int nBlocks, Body body)
 {
-    if (node->frontierOffset != -1)
+    runOnPool(pool, nBlocks, [&](int t)
     {
-        *childrenAtFrontier = node->numChildrenAtFrontier;
-        return node->frontierOffset;
-    }
+        body(t, (int) ((long long) n * t / nBlocks), (int) ((long long) n * (t + 1) / nBlocks));
+    });
+}
 
-    assert(node->nChildren > 0);
-    int last, count;
-    int first = propogateFrontierOffsets(&node->children[0], &count);
-    if (node->nChildsExplored > 1)
+// body(block, begin, end) for nBlocks equal blocks of [0, n), each on its own thread
+template <typename Body>
+void parallelBlocks(int n, int nBlocks, Body body)
+{
+    if (nBlocks == 1)
     {
-        for (int i = 1; i < node->nChildsExplored; i++)
-        {
-            last = propogateFrontierOffsets(&node->children[i], &count);
-        }
-        last += count;
-        count = last - first;
+        body(0, 0, n);
+        return;
     }
 
-    node->frontierOffset = first;
-    node->numChildrenAtFrontier = count;
-
-    *childrenAtFrontier = count;
+    std::thread workers[MAX_THREADS];
+    for (int t = 0; t < nBlocks; t++)
+        workers[t] = searchThread(body, t, (int) ((long long) n * t / nBlocks), (int) ((long long) n * (t + 1) / nBlocks));
+    for (int t = 0; t < nBlocks; t++)
+        workers[t].join();
+}
 
-    return first;
+// the number of blocks worth a thread each
+inline int parallelBlockCount(int n, int nThreads)
+{
+    return max(1, min(nThreads, n / 256));
 }
 
-int exploreSubTreeCount = 0;
-
-bool expandNode(Node **fullCurrentFrontier, float *currentNodeVals, int i, float curBest, Node *subTreeRoot, bool *ignored);
-
-// starts exploring a node as if it's a CUT node with cutVal as the value to check against
-// returns either cutVal if a  better value couldn't be found,  or value of the best found node otherwise
-// works only on CUT and ALL nodes, no node is marked as PV node by this function
-float exploreSubTree(Node *node, float cutVal)
+// body(begin, end) over consecutive slices of [0, n), on up to nThreads threads
+template <typename Body>
+void parallelFor(int n, int nThreads, Body body)
 {
-    exploreSubTreeCount++;
-
-    // isMaxLevel is true if node's *parent* is a MAX level
-    bool isMaxLevel = !node->isMaxNode;
-    if (node->children == NULL)
-    {
-        // leaf node
-        return isMaxLevel ? max(cutVal, node->nodeVal) 
-                          : min(cutVal, node->nodeVal);
-    }
-
-    // full frontier
-    Node **fullCurrentFrontier = NULL;
-    Node **fullNextFrontier = NULL;
+    parallelBlocks(n, parallelBlockCount(n, nThreads), [&](int, int begin, int end) { body(begin, end); });
+}
 
-    // only for the last level
-    float *currentNodeVals;
+// Level synchronous minimax
+//
+// Same results as negaMax() (the root value, and nodeVal and bestChild of every interior node), computed bottom
+// up one level at a time. The interior nodes of each level are listed breadth first, so the children of
+// consecutive nodes are consecutive in the level below: a level's values are a flat array and every node's value
+// is a max (of the negated child values) over a contiguous segment of it, located with a prefix sum over
+// nChildren. Each level is split between the threads, and the segments are reduced with plain loops over
+// Score arrays that the compiler vectorizes. The leaves aren't copied, their parents read them in place.
+Score levelMinimax(Node *root, int depth, int nThreads)
+{
+    TRACE_SCOPE("levelMinimax");
+    if (depth == 0)
+        return evaluateLeaf(root);
 
-    int nCurr, nNext;
+    Node **levels[MAX_DEPTH];
+    int *firstChild[MAX_DEPTH];     // per level, index of each node's first child in the level below (plus the end)
+    int levelSize[MAX_DEPTH];
 
-    // treat passed-in node as CUT node
-    node->nodeType = CUT_NODE;
-    fullCurrentFrontier = &node;
-    nCurr = 1;
+    levels[0] = (Node **) malloc(sizeof(Node *));
+    levels[0][0] = root;
+    levelSize[0] = 1;
 
-    bool currentIsMaxLevel = !isMaxLevel;
-    int subDepth = 0;
-    while (1)
+    for (int d = 0; d < depth - 1; d++)
     {
-        bool secondLastLevel = false;
-        secondLastLevel = (fullCurrentFrontier[0]->children[0].children == NULL);
-
-        // explore the frontier nodes
+        int n = levelSize[d];
+        Node **level = levels[d];
+        int *first = firstChild[d] = (int *) malloc((n + 1) * sizeof(int));
 
-        // figure out total no. of childs that need to be explored for all frontier nodes
-        nNext = 0;
-        for (int j=0; j<nCurr; j++)
+        int sum = 0;
+        for (int j = 0; j < n; j++)
         {
-            switch (fullCurrentFrontier[j]->nodeType)
-            {
-                case ALL_NODE:
-                    // if it's the second last level, we will explore all ALL nodes and find the best immediately
-                    nNext += secondLastLevel ? 1 : fullCurrentFrontier[j]->nChildren;
-                    break;
-                case CUT_NODE:
-                    nNext++;
-                    break;
-            }
+            first[j] = sum;
+            sum += level[j]->nChildren;
         }
-        
-        // no more child nodes, we are at leaves..
-        if (nNext == 0)
-            break;
+        first[n] = sum;
+        levelSize[d + 1] = sum;
 
-        // allocate memory for the next frontier
-        fullNextFrontier = (Node**) malloc (nNext * sizeof(Node *));
+        Node **next = levels[d + 1] = (Node **) malloc(sum * sizeof(Node *));
+        parallelFor(n, nThreads, [=](int begin, int end)
+        {
+            for (int j = begin; j < end; j++)
+                for (int k = 0; k < level[j]->nChildren; k++)
+                    next[first[j] + k] = &level[j]->children[k];
+        });
+    }
 
-        if (secondLastLevel) {
-            assert(nCurr == nNext);
-            currentNodeVals = (float *)malloc(nNext * sizeof(float));
-        }
-        
-        int index = 0;
-        // fill in the next frontier
-        for (int j=0; j<nCurr; j++)
+    // the level above the leaves reads them in place (they're most of the tree), the value of a leaf from the
+    // point of view of its parent is -eval for even depths, eval for odd depths
+    Score *vals;
+    {
+        Node **level = levels[depth - 1];
+        Score *levelVals = vals = (Score *) malloc(levelSize[depth - 1] * sizeof(Score));
+        bool negate = !(depth % 2);
+        parallelFor(levelSize[depth - 1], nThreads, [=](int begin, int end)
         {
-            switch (fullCurrentFrontier[j]->nodeType)
+            for (int j = begin; j < end; j++)
             {
-                case ALL_NODE:
-                    if (secondLastLevel)
-                    {
-                        Node * curNode = fullCurrentFrontier[j];
-                        curNode->nodeVal = curNode->isMaxNode ? -INF : INF;
-                        for (int k = 0; k < curNode->nChildren; k++)
-                        {
-                            if (curNode->isMaxNode)
-                            {
-                                if (curNode->children[k].nodeVal > curNode->nodeVal)
-                                {
-                                    curNode->nodeVal = curNode->children[k].nodeVal;
-                                    curNode->best = &curNode->children[k];
-                                    curNode->bestChild = k;
-                                }
-                            }
-                            else
-                            {
-                                if (curNode->children[k].nodeVal < curNode->nodeVal)
-                                {
-                                    curNode->nodeVal = curNode->children[k].nodeVal;
-                                    curNode->best = &curNode->children[k];
-                                    curNode->bestChild = k;
-                                }
-                            }
-                        }
-                        if (secondLastLevel)
-                            currentNodeVals[index] = curNode->nodeVal;
-                        fullNextFrontier[index++] = curNode;
-                        curNode->nChildsExplored = curNode->nChildren;
-                    }
-                    else
-                    {
-                        for (int k = 0; k < fullCurrentFrontier[j]->nChildren; k++)
-                        {
-                            Node *curNode = &(fullCurrentFrontier[j]->children[k]);
-                            curNode->nodeType = CUT_NODE;   // child of ALL node is cut node
-                            fullNextFrontier[index++] = curNode;
-                        }
-                        fullCurrentFrontier[j]->nChildsExplored = fullCurrentFrontier[j]->nChildren;
-                        fullCurrentFrontier[j]->best = &(fullCurrentFrontier[j]->children[0]);
-                    }
-                    break;
-                case CUT_NODE:
+                Node *node = level[j];
+                Score best = -INF;
+                int bestChild = 0;
+                for (int k = 0; k < node->nChildren; k++)
+                {
+                    Score v = negate ? -evaluateLeaf(&node->children[k]) : evaluateLeaf(&node->children[k]);
+                    if (v > best)
                     {
-                        fullCurrentFrontier[j]->nChildsExplored = 1;
-                        fullCurrentFrontier[j]->best = &(fullCurrentFrontier[j]->children[0]);
-                        fullCurrentFrontier[j]->children[0].nodeType = ALL_NODE;
-                        fullNextFrontier[index] = &(fullCurrentFrontier[j]->children[0]);
-                        if (secondLastLevel)
-                        {
-                            currentNodeVals[index] = fullNextFrontier[index]->nodeVal;
-                            fullCurrentFrontier[j]->nodeVal = currentNodeVals[index];
-                        }
-                        index++;
+                        best = v;
+                        bestChild = k;
                     }
-            }
+                }
 
-            if (secondLastLevel)
-            {
-                fullNextFrontier[j]->numChildrenAtFrontier = 1;
-                fullNextFrontier[j]->frontierOffset = j;
+                nodeState(node)->nodeVal = best;
+                nodeState(node)->bestChild = bestChild;
+                levelVals[j] = best;
             }
-        }
+        });
+        free(levels[depth - 1]);
+    }
 
-        // go to next depth, set current = next
-        if (subDepth != 0)
-            free (fullCurrentFrontier);
+    for (int d = depth - 2; d >= 0; d--)
+    {
+        Node **level = levels[d];
+        int *first = firstChild[d];
+        Score *childVals = vals;
+        Score *levelVals = (Score *) malloc(levelSize[d] * sizeof(Score));
 
-        nCurr = nNext;
-        fullCurrentFrontier = fullNextFrontier;
+        parallelFor(levelSize[d], nThreads, [=](int begin, int end)
+        {
+            for (int j = begin; j < end; j++)
+            {
+                const Score *seg = childVals + first[j];
+                int n = first[j + 1] - first[j];
 
-        subDepth++;
+                Score best = -INF;
+                for (int k = 0; k < n; k++)
+                {
+                    Score v = -seg[k];
+                    best = v > best ? v : best;
+                }
 
-        currentIsMaxLevel = !currentIsMaxLevel;
+                // first child with the best value, like negaMax()
+                int bestChild = 0;
+                while (-seg[bestChild] != best)
+                    bestChild++;
 
-        if (secondLastLevel)
-            break;
+                nodeState(level[j])->nodeVal = best;
+                nodeState(level[j])->bestChild = bestChild;
+                levelVals[j] = best;
+            }
+        });
+
+        free(childVals);
+        vals = levelVals;
+        free(levels[d]);
+        free(firstChild[d]);
     }
 
-    int count;
-    int start = propogateFrontierOffsets(node, &count);
-    assert(start == 0 && count == nCurr);
-    
-    float *minScan = (float *)malloc(sizeof(float) * nCurr);
-    float *maxScan = (float *)malloc(sizeof(float) * nCurr);
-    bool *ignored = (bool *)malloc(sizeof(bool) * nCurr);
-    memset(ignored, 0, sizeof(bool) * nCurr);
+    Score val = vals[0];
+    free(vals);
+    return val;
+}
 
-    float curMin, curMax;
-    curMin = curMax = cutVal;  // init. with cut val
 
-    float computedVal = isMaxLevel ? -INF : INF;
 
-    int nRejected;
-    int nExpnded;
+// per thread so that the parallel searches can reuse alphabeta() as is
+thread_local int gInteriorNodesVisited = 0;
+thread_local int gLeafNodesVisited = 0;
 
-    do
-    {
-        nRejected = 0;
-        nExpnded = 0;
 
-        curMin = curMax = cutVal;
+// Search budget for anytime searches
+//
+// A search started with a budget stops when it has visited maxNodes nodes, when maxMicroseconds of
+// wall clock time have passed or when the caller sets *cancel, whichever comes first, and reports the
+// best root move and bound known at that point. The budget is only looked at every
+// BUDGET_CHECK_INTERVAL nodes (per thread), the searches only decrement a counter per node.
 
-        for (int i = 0; i < nCurr; i++)
-        {
-            // all nodes that are explored here must be ALL nodes
-            assert(fullCurrentFrontier[i]->nodeType = ALL_NODE ||
-                fullCurrentFrontier[i]->nChildsExplored == fullCurrentFrontier[i]->nChildren);
+#define BUDGET_CHECK_INTERVAL 1024
 
-            if (ignored[i])
-                continue;
+struct SearchBudget
+{
+    int    maxNodes;                // 0: no limit
+    double maxMicroseconds;         // 0: no limit
+    std::atomic<bool> *cancel;      // NULL: no cancel flag
+};
 
-            minScan[i] = curMin;
-            maxScan[i] = curMax;
+struct SearchResult
+{
+    Score value;        // exact value if completed, otherwise best bound known (see the engine)
+    int   bestChild;    // best root move known
+    bool  completed;    // false if the search was stopped by the budget
+    int   nodes;        // nodes visited
+    double time;        // ms
+};
 
-            // this node was expected to be less than the PV node value
-            if (isMaxLevel)
-            {
-                if (currentNodeVals[i] <= curMin)
-                {
-                    // reject this branch (i.e, no need to evaluate any more siblings)
-                    nRejected++;
-                    ignored[i] = true;
-                }
-                if (currentNodeVals[i] > curMax)
-                {
-                    curMax = currentNodeVals[i];
-                    // need to evaluate more siblings of this node
-                    if (expandNode(fullCurrentFrontier, currentNodeVals, i, curMax, node, ignored))
-                        nExpnded++;
-                    computedVal = currentNodeVals[i];
-                }
-            }
-            else //if (!isMaxLevel)
-            {
-                if (currentNodeVals[i] >= curMax)
-                {
-                    // reject this branch (i.e, no need to evaluate any more siblings of this node)
-                    nRejected++;
-                    ignored[i] = true;
-                }
-                if (currentNodeVals[i] < curMin)
-                {
-                    curMin = currentNodeVals[i];
-                    // need to evaluate more siblings of this node
-                    if(expandNode(fullCurrentFrontier, currentNodeVals, i, curMin, node, ignored))
-                        nExpnded++;
-                    computedVal = currentNodeVals[i];
-                }
-            }
-        }
+const SearchBudget *gBudget = NULL;
+std::atomic<bool> gSearchStopped(false);
+std::atomic<int> gBudgetNodes(0);
+LARGE_INTEGER gBudgetStart, gBudgetFreq;
 
-        // the loop is done when nothing gets expanded anymore
-    } while (nExpnded);
+thread_local int gBudgetCountdown = BUDGET_CHECK_INTERVAL;
+thread_local int gBudgetPending = 0;       // nodes not yet added to gBudgetNodes
+thread_local int gBudgetLastVisited = 0;   // alphabeta's visited count at the last check
 
-    return isMaxLevel ? max(cutVal, computedVal)
-                      : min(cutVal, computedVal);
+void startBudget(const SearchBudget *budget)
+{
+    QueryPerformanceFrequency(&gBudgetFreq);
+    QueryPerformanceCounter(&gBudgetStart);
+    gBudgetNodes = 0;
+    gSearchStopped = false;
+    gBudget = budget;
 }
 
-// returns true if the node was actually expanded (sibling evaluated)
-//         false otherwise (if there are no siblings, or if the node is a PV or subTreeRoot)
-bool expandNode(Node **fullCurrentFrontier, float *currentNodeVals, int i, float curBest, Node *subTreeRoot, bool *ignored)
+// returns true if the search was stopped before completion
+bool endBudget()
 {
-    Node *thisNode = fullCurrentFrontier[i];
-    bool isMaxLevel = thisNode->isMaxNode;
-
-    // no need to explore any siblings if the current node itself is subtree root!
-    if (thisNode == subTreeRoot)
-        return false;
+    bool stopped = gSearchStopped;
+    gBudget = NULL;
+    gSearchStopped = false;
+    return stopped;
+}
 
-    Node *parentNode = thisNode->parent;
+// to be called by every thread taking part in a budgeted search before it starts searching
+void budgetThreadStart()
+{
+    gBudgetCountdown = BUDGET_CHECK_INTERVAL;
+    gBudgetPending = 0;
+    gBudgetLastVisited = gLeafNodesVisited + gInteriorNodesVisited;
+}
 
-    assert(parentNode->nodeType == CUT_NODE);
+// adds the nodes the calling thread visited since its last check to gBudgetNodes, when it's done searching
+void budgetThreadEnd()
+{
+    int visited = gLeafNodesVisited + gInteriorNodesVisited;
+    gBudgetNodes += gBudgetPending + visited - gBudgetLastVisited;
+    gBudgetPending = 0;
+    gBudgetLastVisited = visited;
+}
 
-    Node *currentParent = parentNode;
-    while (currentParent->nChildsExplored == currentParent->nChildren)
-    {
-        // break out early if we reached the subTreeRoot!
-        if (currentParent == subTreeRoot)
-        {
-            //if (isBetter(currentParent, currentNodeVals[i]))
-            {
-                currentParent->best = thisNode;
-                currentParent->nodeVal = currentNodeVals[i];
-                thisNode->nodeType = PV_NODE;
-            }
-            return false;
-        }
-        // already explored the last child, need to explore more nodes of GrandParent of Parent node?
-        // parent of parent should be an ALL node, with everything explored already ?
-        currentParent->nodeVal = currentNodeVals[i];
-        thisNode = currentParent;
-        currentParent = currentParent->parent;
+// slow path: account for 'nodes' more visited nodes and check all the limits
+bool budgetExpired(int nodes)
+{
+    if (gSearchStopped)
+        return true;
 
-        if (currentParent->nodeType == ALL_NODE)
-        {
-            //if (isBetter(currentParent, currentNodeVals[i]))
+    int total = (gBudgetNodes += nodes);
+    bool stop = false;
 
-            // when moving up, only cross an ALL node only when 
-            //  i)  either it's the last child
-            //  ii) there is no 'open' child towards the right of current node
-            //     - open CHILD are the nodes that have possibility of being better than the current node
-            bool isBest = true;
-            // bool onRight = false;
+    if (gBudget->maxNodes && total >= gBudget->maxNodes)
+        stop = true;
 
-            // TODO: Check only nodes towards the right. No need to check all nodes of parent
-            // ANKAN - BUG! TODO!!! just checking nodes towards right doesn't work. Figure out why?
+    if (gBudget->cancel && *gBudget->cancel)
+        stop = true;
 
-            for (int n = 0; n < currentParent->nChildren; n++)
-            {
-                if ((&currentParent->children[n]) != thisNode)
-                {
-                    //if (!onRight)
-                    //    continue;
+    if (gBudget->maxMicroseconds > 0)
+    {
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        double us = ((double)(now.QuadPart - gBudgetStart.QuadPart) * 1000000.0) / gBudgetFreq.QuadPart;
+        if (us >= gBudget->maxMicroseconds)
+            stop = true;
+    }
 
-                    for (int k = 0; k < currentParent->children[n].numChildrenAtFrontier; k++)
-                    {
-                        int frontierOffset = currentParent->children[n].frontierOffset + k;
-                        if ((!ignored[frontierOffset]) &&
-                            isBetter(currentParent->isMaxNode, currentNodeVals[frontierOffset], currentNodeVals[i]))
-                        {
-                            isBest = false;
-                        }
-                        else
-                        {
-                            ignored[frontierOffset] = true;
-                        }
-                    }
-                    if (!isBest)
-                    {
-                        break;
-                    }
-                }
-                //else
-                //{
-                //    onRight = true;
-                //}
-            }
+    if (stop)
+        gSearchStopped = true;
 
+    return stop;
+}
 
-            if (isBest)
-            {
-                currentParent->best = thisNode;
-                currentParent->nodeVal = currentNodeVals[i];
-            }
-            else
-            {
-                // wait for other better nodes to be sorted, out
-                // don't move up
-                return false;
-            }
-        }
+// per node check for the searches that don't count nodes themselves. Searches with expensive nodes
+// can ask for more frequent checks
+inline bool budgetTick(int nodes, int checkInterval = BUDGET_CHECK_INTERVAL)
+{
+    gBudgetPending += nodes;
+    if (gBudgetPending < checkInterval)
+        return gSearchStopped;
 
-        if (currentParent->nodeType == PV_NODE)
-        {
-            // Ankan TODO: might need to propogate up only if it's actually better
-            currentParent->best = thisNode;
-            thisNode->nodeType = PV_NODE;
+    int pending = gBudgetPending;
+    gBudgetPending = 0;
+    return budgetExpired(pending);
+}
 
+// alphabeta's slow path, taken every BUDGET_CHECK_INTERVAL interior nodes
+bool alphabetaBudgetExpired()
+{
+    gBudgetCountdown = BUDGET_CHECK_INTERVAL;
+    int visited = gLeafNodesVisited + gInteriorNodesVisited;
+    int nodes = visited - gBudgetLastVisited;
+    gBudgetLastVisited = visited;
+    return budgetExpired(nodes);
+}
 
-            // currentParent->nodeVal = currentNodeVals[i];
+template <bool checkBudget>
+Score alphabetaT(Node *node, int depth, int origDepth, Score alpha, Score beta)
+{
+    TRACE_SCOPE_IF(depth == origDepth, "alphabeta");
+    if (depth == 0)
+    {
+        gLeafNodesVisited++;
 
-            // need to propogate the value all the way to root!
-            while (currentParent)
-            {
-                currentParent->nodeVal = currentNodeVals[i];
+        // eval for even depths, -eval for odd depths
+        if (origDepth % 2 == 0)
+            return evaluateLeaf(node);
+        else
+            return -evaluateLeaf(node);
+    }
 
-                // stop when the chain of PV nodes breaks!
-                if (currentParent->nodeType != PV_NODE)
-                    break;
-                currentParent = currentParent->parent;
-            }
+    gInteriorNodesVisited++;
 
-            return false;
-        }
-    }
+    if (checkBudget && --gBudgetCountdown == 0 && alphabetaBudgetExpired())
+        return alpha;
+
+    // choose the best child
+    int bestChild = 0;
 
-    assert(currentParent->nodeType != PV_NODE);
+    for (int i = 0; i < node->nChildren; i++)
     {
-        // here we have a parent node with unexplored children, explore one of them
-        //assert(currentParent->nodeType == CUT_NODE);
-        Node *sibling = &(currentParent->children[currentParent->nChildsExplored]);
-        sibling->nodeType = ALL_NODE;
-        currentParent->nChildsExplored++;
-        float siblingVal = exploreSubTree(sibling, curBest);
-        if (currentParent->isMaxNode && siblingVal > currentNodeVals[i])
-        {
-            currentNodeVals[i] = siblingVal;
-            currentParent->best = sibling;
-            fullCurrentFrontier[i] = sibling;
-        }
-        if ((!currentParent->isMaxNode) && siblingVal < currentNodeVals[i])
-        {
-            currentNodeVals[i] = siblingVal;
-            currentParent->best = sibling;
-            fullCurrentFrontier[i] = sibling;
-        }
+        Score curScore = -alphabetaT<checkBudget>(&node->children[i], depth - 1, origDepth, -beta, -alpha);
 
-    }
-    currentParent->nodeVal = currentNodeVals[i];
+        // the value of a stopped search is meaningless, just unwind
+        if (checkBudget && gSearchStopped)
+            return alpha;
 
-    // propogate the value all the way up if the parent's value was coming from this node
-    Node *cur = currentParent;
-    while (true)
-    {
-        Node *par = cur->parent;
-        if (par->best == cur)
+        if (curScore >= beta)
         {
-            par->nodeVal = cur->nodeVal;
-            cur = par;
+            nodeState(node)->bestChild = i;    // the refutation, tried first when the tree is reused (see advanceRoot)
+            nodeState(node)->nChildsExplored = i + 1;
+            return beta;
         }
-        else
+
+        if (curScore > alpha)
         {
-            break;
+            alpha = curScore;
+            bestChild = i;
         }
     }
 
-    return true;
+    NodeState *state = nodeState(node);
+    state->nodeVal = alpha;
+    state->bestChild = bestChild;
+    state->nChildsExplored = node->nChildren;
+
+    return alpha;
+
 }
 
-// a non-recursive and hopefully somewhat parallel algorithm based on alpha beta
-float exploreTree(Node *node, int depth)
+Score alphabeta(Node *node, int depth, int origDepth, Score alpha, Score beta)
 {
-    exploreSubTreeCount = 0;
+    return alphabetaT<false>(node, depth, origDepth, alpha, beta);
+}
 
-    // the frontier / current list of nodes that need to be explored / nodes at the current level
-    // TODO: many of these lists are probably redundant - get rid of some later
-    Node *currentPVNode   = NULL;       Node *nextPVNode   = NULL;
-    Node *currentCutNodes = NULL;       Node *nextCutNodes = NULL;
-    Node *currentAllNodes = NULL;       Node *nextAllNodes = NULL;
-    int nCutNodes = 0, nAllNodes = 0;
-    int nNextCutNodes = 0, nNextAllNodes = 0;
+// Batched alpha-beta
+//
+// For many small searches on one core: BATCH_LANES independent trees are searched in lockstep, one per lane.
+// Every step moves each lane by one node, down to its next child or back up with a value. The current frame
+// of every lane (node, next child, alpha, beta, best child) is kept as arrays indexed by lane, and applying a
+// returned value is done for all the lanes at once with selects instead of branches, the lanes without a value
+// and the cutoffs being masks, so the compiler vectorizes it. Going down and up is per lane, with a stack of
+// frames per lane, and parents of leaves are searched in one step. The lanes' trees share nothing: the children
+// of the node each lane goes to next are prefetched, and arrive while the other lanes take their steps instead
+// of being waited for one at a time. A lane that is done with its tree takes the next one.
+// Visits the same nodes and gives the same values and bestChild as alphabeta() on each tree.
+
+#define BATCH_LANES 8       // 16 for AVX-512 builds
+
+struct BatchedFrame
+{
+    Node *node;
+    Score alpha, beta;
+    int child, nChildren, bestChild;
+};
 
-    // full frontier
-    Node **fullCurrentFrontier = NULL;
-    Node **fullNextFrontier    = NULL;
-    int nCurr, nNext;
+// values[t] gets alphabeta(trees[t], depth, depth, -INF, INF)
+void batchedAlphabeta(Node **trees, int nTrees, int depth, Score *values)
+{
+    TRACE_SCOPE("batchedAlphabeta");
+    if (depth == 0)
+    {
+        for (int t = 0; t < nTrees; t++)
+            values[t] = evaluateLeaf(trees[t]);
+        return;
+    }
 
-    // 1. PV based initial tree generation
-    node->nodeType = PV_NODE;   // the root is always a PV node
-    currentPVNode = node;
-    fullCurrentFrontier = &node;
-    nCurr = 1;
+    // current frame of each lane
+    Node *node[BATCH_LANES];
+    Score alpha[BATCH_LANES], beta[BATCH_LANES];
+    int   child[BATCH_LANES], nChildren[BATCH_LANES], bestChild[BATCH_LANES];
 
-    bool isMaxLevel = true;
-    for (int i = 0; i < depth - 1; i++)
-    {
-        // explore the frontier nodes
+    // value returned by the child just searched, if any
+    Score ret[BATCH_LANES];
+    bool  hasRet[BATCH_LANES];
 
-        // figure out total no. of childs that need to be explored for all frontier nodes
-        nNext = 0;
-        for (int j=0; j<nCurr; j++)
-        {
-            int childsToExplore = 0;
-            switch (fullCurrentFrontier[j]->nodeType)
-            {
-                case PV_NODE:
-                case ALL_NODE:
-                    childsToExplore = fullCurrentFrontier[j]->nChildren;
-                    break;
-                case CUT_NODE:
-                    childsToExplore = 1;
-                    break;
-            }
+    int ply[BATCH_LANES];
+    int tree[BATCH_LANES];      // -1 for idle lanes
+    BatchedFrame stack[BATCH_LANES][MAX_DEPTH];
 
-            nNext += childsToExplore;
-        }
-        
-        // allocate memory for the next frontier
-        fullNextFrontier = (Node**) malloc (nNext * sizeof(Node *));
-        
-        int index = 0;
-        // fill in the next frontier
-        for (int j=0; j<nCurr; j++)
-        {
-            switch (fullCurrentFrontier[j]->nodeType)
-            {
-                case PV_NODE:
-                    for (int k = 0; k < fullCurrentFrontier[j]->nChildren; k++)
-                    {
-                        Node *curNode = &(fullCurrentFrontier[j]->children[k]);
-                        if (index == 0) // first child of PV node is PV node
-                            curNode->nodeType = PV_NODE;
-                        else            // others are CUT nodes
-                            curNode->nodeType = CUT_NODE;
-                        fullNextFrontier[index++] = curNode;
-                    }
-                    fullCurrentFrontier[j]->nChildsExplored = fullCurrentFrontier[j]->nChildren;
+    int nextTree = 0;
+    int nActive = 0;
+    int leafVisits = 0, interiorVisits = 0;
 
-                    break;
-                case ALL_NODE:
-                    for (int k = 0; k < fullCurrentFrontier[j]->nChildren; k++)
-                    {
-                        Node *curNode = &(fullCurrentFrontier[j]->children[k]);
-                        curNode->nodeType = CUT_NODE;   // child of ALL node is cut node
-                        fullNextFrontier[index++] = curNode;
-                    }
-                    fullCurrentFrontier[j]->nChildsExplored = fullCurrentFrontier[j]->nChildren;
-                    break;
-                case CUT_NODE:
-                    {
-                        fullCurrentFrontier[j]->nChildsExplored = 1;
-                        fullCurrentFrontier[j]->children[0].nodeType = ALL_NODE;
-                        fullNextFrontier[index++] = &(fullCurrentFrontier[j]->children[0]);
-                    }
-            }
+    // eval for even depths, -eval for odd depths
+    Score sign = depth % 2 == 0 ? 1 : -1;
+    auto leafEval = [=](Node *leaf) { return (Score) (sign * evaluateLeaf(leaf)); };
 
-            // Ankan - not known yet, but initialize with first child
-            fullCurrentFrontier[j]->best = &(fullCurrentFrontier[j]->children[0]);
-            fullCurrentFrontier[j]->bestChild = 0;
+    // (re)starts a lane at the root of the next tree
+    auto startTree = [&](int l)
+    {
+        if (nextTree == nTrees)
+        {
+            tree[l] = -1;
+            node[l] = NULL;
+            child[l] = nChildren[l] = 0;
+            alpha[l] = beta[l] = ret[l] = 0;
+            hasRet[l] = false;
+            return;
         }
+        tree[l] = nextTree++;
+        node[l] = trees[tree[l]];
+        alpha[l] = -INF;
+        beta[l] = INF;
+        child[l] = 0;
+        nChildren[l] = node[l]->nChildren;
+        bestChild[l] = 0;
+        ret[l] = 0;
+        hasRet[l] = false;
+        ply[l] = 0;
+        interiorVisits++;
+        nActive++;
+    };
 
-        assert(index == nNext);
+    for (int l = 0; l < BATCH_LANES; l++)
+        startTree(l);
 
-        // go to next depth, set current = next
-        if (i!=0)
-            free (fullCurrentFrontier);
+    while (nActive)
+    {
+        // apply the returned values, all lanes at once
+        bool done[BATCH_LANES], cutoff[BATCH_LANES];
+        Score result[BATCH_LANES];
+        for (int l = 0; l < BATCH_LANES; l++)
+        {
+            Score score = -ret[l];
+            bool cut = hasRet[l] & (score >= beta[l]);
+            bool improved = hasRet[l] & !cut & (score > alpha[l]);
+            alpha[l] = improved ? score : alpha[l];
+            bestChild[l] = (improved | cut) ? child[l] - 1 : bestChild[l];
+            done[l] = cut | (child[l] == nChildren[l]);
+            result[l] = cut ? beta[l] : alpha[l];
+            cutoff[l] = cut;
+            hasRet[l] = false;
+        }
 
-        nCurr = nNext;
-        fullCurrentFrontier = fullNextFrontier;
+        for (int l = 0; l < BATCH_LANES; l++)
+        {
+            if (tree[l] < 0)
+                continue;
 
-        isMaxLevel = !isMaxLevel;
-    }
-    
+            if (done[l])
+            {
+                // same as alphabeta(): a cut node only records its refutation
+                if (!cutoff[l])
+                    nodeState(node[l])->nodeVal = result[l];
+                nodeState(node[l])->bestChild = bestChild[l];
 
-    // when generating the last level evaluate all ALL nodes at the level just above the CUT node leaves
-    // for depth 5 search, we need to do a MAX reduction (see modern gpu's segmented reduction example when implementing parallel version)
+                if (ply[l] == 0)
+                {
+                    values[tree[l]] = result[l];
+                    nActive--;
+                    startTree(l);
+                    continue;
+                }
 
-    fullNextFrontier = (Node**) malloc (nCurr * sizeof(Node *));
-    bool *expectedMore = (bool*) malloc (nCurr * sizeof(bool));
-    float *currentNodeVals = (float *) malloc(nCurr * sizeof(float));
+                BatchedFrame &f = stack[l][--ply[l]];
+                node[l] = f.node;
+                alpha[l] = f.alpha;
+                beta[l] = f.beta;
+                child[l] = f.child;
+                nChildren[l] = f.nChildren;
+                bestChild[l] = f.bestChild;
+                ret[l] = result[l];
+                hasRet[l] = true;
+                continue;
+            }
 
-    for (int i=0;i<nCurr;i++)
-    {
-        Node *curNode = fullCurrentFrontier[i];
-        curNode->nodeVal = isMaxLevel ? -INF : INF;
-        if(curNode->nodeType == PV_NODE || curNode->nodeType == ALL_NODE)
-        {
-            for (int k = 0; k < curNode->nChildren; k++)
+            Node *next = &node[l]->children[child[l]++];
+            if (ply[l] + 1 == depth)
+            {
+                leafVisits++;
+                ret[l] = leafEval(next);
+                hasRet[l] = true;
+                continue;
+            }
+
+            if (ply[l] + 2 == depth)
             {
-                if (isMaxLevel)
+                // a parent of leaves is searched right away, its leaves were prefetched a step earlier
+                interiorVisits++;
+                Score a = -beta[l], b = -alpha[l];
+                int best = 0;
+                bool cut = false;
+                for (int i = 0; i < next->nChildren; i++)
                 {
-                    if (curNode->children[k].nodeVal > curNode->nodeVal)
+                    leafVisits++;
+                    Score score = -leafEval(&next->children[i]);
+                    if (score >= b)
                     {
-                        curNode->nodeVal = curNode->children[k].nodeVal;
-                        curNode->best = &curNode->children[k];
-                        curNode->bestChild = k;
+                        nodeState(next)->bestChild = i;
+                        cut = true;
+                        break;
                     }
-                }
-                else
-                {
-                    if (curNode->children[k].nodeVal < curNode->nodeVal)
+                    if (score > a)
                     {
-                        curNode->nodeVal = curNode->children[k].nodeVal;
-                        curNode->best = &curNode->children[k];
-                        curNode->bestChild = k;
+                        a = score;
+                        best = i;
                     }
                 }
+                if (!cut)
+                {
+                    nodeState(next)->nodeVal = a;
+                    nodeState(next)->bestChild = best;
+                }
+                ret[l] = cut ? b : a;
+                hasRet[l] = true;
+                continue;
             }
-            fullNextFrontier[i] = curNode;
-            currentNodeVals[i] = curNode->nodeVal;
-            curNode->nChildsExplored = curNode->nChildren;
-            expectedMore[i] = isMaxLevel ? false : true;
+
+            BatchedFrame &f = stack[l][ply[l]++];
+            f.node = node[l];
+            f.alpha = alpha[l];
+            f.beta = beta[l];
+            f.child = child[l];
+            f.nChildren = nChildren[l];
+            f.bestChild = bestChild[l];
+
+            interiorVisits++;
+            Score parentAlpha = alpha[l];
+            node[l] = next;
+            alpha[l] = -beta[l];
+            beta[l] = -parentAlpha;
+            child[l] = 0;
+            nChildren[l] = next->nChildren;
+            bestChild[l] = 0;
         }
-        else
+
+        // start loading the children of the nodes the lanes go to next, they are needed a step later
+        for (int l = 0; l < BATCH_LANES; l++)
         {
-            curNode->best = &curNode->children[0];
-            curNode->bestChild = 0;
+            if (child[l] == nChildren[l])
+                continue;
 
-            curNode->nChildsExplored = 1;
-            curNode->children[0].nodeType = ALL_NODE;
-            fullNextFrontier[i] = &curNode->children[0];
-            currentNodeVals[i] = fullNextFrontier[i]->nodeVal;
-            expectedMore[i] = isMaxLevel ? true : false;
+            Node *upcoming = &node[l]->children[child[l]];
+            for (char *p = (char *) upcoming->children; p < (char *) (upcoming->children + upcoming->nChildren); p += 64)
+                PreFetchCacheLine(PF_TEMPORAL_LEVEL_1, p);
         }
-
-        fullNextFrontier[i]->numChildrenAtFrontier = 1;
-        fullNextFrontier[i]->frontierOffset = i;
     }
 
-    free (fullCurrentFrontier);
-    fullCurrentFrontier = fullNextFrontier;
+    gLeafNodesVisited += leafVisits;
+    gInteriorNodesVisited += interiorVisits;
+}
 
+// Games
+//
+// The engines search trees of struct Node made by genTree(), with uniform random branching and random leaf
+// values. For real branching and move ordering a game provides a position type and these overloads:
+//   int   generateMoves(const Position &pos, int *moves)   moves in the order to try them (at most
+//                                                          MAX_GAME_MOVES), 0 when the game is over
+//   void  makeMove(Position &pos, int move)
+//   int   evaluate(const Position &pos)                    in hundredths, for the side to move. For a finished
+//                                                          game the result, otherwise a heuristic
+// gameAlphabeta() searches the positions directly. For the other engines genGameTree() builds the game tree
+// as a Node tree, with children in move order and leaf values for the root player, like genTree() does.
+// A game that ends above the leaf depth continues with a line of single children so that all leaves are at
+// the same depth (what the engines expect), each leaf carrying the result.
+
+#define MAX_GAME_MOVES 64
+
+// Connect-4 on the standard 7 x 6 board, bitboards with a column of 7 bits each (6 cells and an empty one on
+// top) so that 4 in a row are found with shifts
+struct Connect4
+{
+    unsigned long long current;    // stones of the side to move
+    unsigned long long mask;       // all stones
+    int nMoves;
+};
 
-    float *minScan = (float *) malloc (sizeof(float) * nCurr);
-    float *maxScan = (float *) malloc (sizeof(float) * nCurr);
-    bool *ignored = (bool *)malloc(sizeof(bool) * nCurr);
-    memset(ignored, 0, sizeof(bool) * nCurr);
+#define C4_WIDTH  7
+#define C4_HEIGHT 6
+#define C4_WIN    5000              // minus the number of moves, faster wins are better
 
-    float curMin, curMax;
-    curMin = curMax = currentNodeVals[0];  // init. with value of PV node
+Connect4 connect4Start()
+{
+    Connect4 pos = {0, 0, 0};
+    return pos;
+}
 
-    int nRejected = 0;
-    int nExpnded = 0;
+bool connect4Aligned(unsigned long long stones)
+{
+    // horizontal, the two diagonals and vertical
+    const int shifts[4] = {C4_HEIGHT + 1, C4_HEIGHT, C4_HEIGHT + 2, 1};
+    for (int d = 0; d < 4; d++)
+    {
+        unsigned long long m = stones & (stones >> shifts[d]);
+        if (m & (m >> (2 * shifts[d])))
+            return true;
+    }
+    return false;
+}
 
-    // propogate frontier offsets from leafs up the tree
-    int count;
-    int start = propogateFrontierOffsets(node, &count);
-    assert(start == 0 && count == nCurr);
+int generateMoves(const Connect4 &pos, int *moves)
+{
+    // the last move won, or the board is full
+    if (connect4Aligned(pos.current ^ pos.mask) || pos.nMoves == C4_WIDTH * C4_HEIGHT)
+        return 0;
+
+    // center columns first
+    const int order[C4_WIDTH] = {3, 2, 4, 1, 5, 0, 6};
+    int nMoves = 0;
+    for (int i = 0; i < C4_WIDTH; i++)
+    {
+        unsigned long long top = 1ULL << (C4_HEIGHT - 1 + order[i] * (C4_HEIGHT + 1));
+        if (!(pos.mask & top))
+            moves[nMoves++] = order[i];
+    }
+    return nMoves;
+}
 
-    int iterations = 0;
+void makeMove(Connect4 &pos, int column)
+{
+    pos.current ^= pos.mask;
+    pos.mask |= pos.mask + (1ULL << (column * (C4_HEIGHT + 1)));
+    pos.nMoves++;
+}
 
-    do
-    {
-        iterations++;
+int evaluate(const Connect4 &pos)
+{
+    if (connect4Aligned(pos.current ^ pos.mask))
+        return -(C4_WIN - pos.nMoves);
+    if (pos.nMoves == C4_WIDTH * C4_HEIGHT)
+        return 0;
 
-        nRejected = 0;
-        nExpnded = 0;
+    // number of 4 cell lines through each cell
+    static const int lines[C4_HEIGHT][C4_WIDTH] =
+    {
+        {3, 4, 5,  7,  5, 4, 3},
+        {4, 6, 8,  10, 8, 6, 4},
+        {5, 8, 11, 13, 11, 8, 5},
+        {5, 8, 11, 13, 11, 8, 5},
+        {4, 6, 8,  10, 8, 6, 4},
+        {3, 4, 5,  7,  5, 4, 3},
+    };
 
-        // ignore all nodes to the left of bestNow
-        for (int i = 0; i < nCurr; i++)
+    int val = 0;
+    for (int c = 0; c < C4_WIDTH; c++)
+    {
+        for (int r = 0; r < C4_HEIGHT; r++)
         {
-            ignored[i] = true;
+            unsigned long long bit = 1ULL << (r + c * (C4_HEIGHT + 1));
+            if (pos.current & bit)
+                val += lines[r][c];
+            else if (pos.mask & bit)
+                val -= lines[r][c];
+        }
+    }
+    return val * 10;
+}
 
-            // Unnecessary and expensive. TODO: figure out better way
-            bool found = false;
-            Node *bestNow = node;
-            while (bestNow->children)
-            {
-                bestNow = bestNow->best;
-                if (bestNow == fullCurrentFrontier[i])
-                {
-                    found = true;
-                }
-            }
+// Othello on bitboards, square = row * 8 + column. A side without moves passes (OTHELLO_PASS), the game is
+// over when neither side can move
+struct Othello
+{
+    unsigned long long player;      // discs of the side to move
+    unsigned long long opponent;
+};
 
-            if (found)
-            {
-                curMin = curMax = bestNow->nodeVal;
-                break;
-            }
-        }
+#define OTHELLO_PASS 64
+#define OTHELLO_WIN  5000           // plus the disc difference
 
-        for (int i = 1; i < nCurr; i++)
-        {
-            // all nodes that are explored here must be ALL nodes
-            assert(fullCurrentFrontier[i]->nodeType = ALL_NODE ||
-                   fullCurrentFrontier[i]->nChildsExplored == fullCurrentFrontier[i]->nChildren);
+Othello othelloStart()
+{
+    // black (to move) on e4 and d5, white on d4 and e5
+    Othello pos = {(1ULL << 28) | (1ULL << 35), (1ULL << 27) | (1ULL << 36)};
+    return pos;
+}
 
-            if (ignored[i])
-                continue;
+// discs moved one square in direction dir (0 - 7), dropping the ones that would wrap around the board
+inline unsigned long long othelloShift(unsigned long long discs, int dir)
+{
+    const unsigned long long notA = 0xfefefefefefefefeULL, notH = 0x7f7f7f7f7f7f7f7fULL;
+    switch (dir)
+    {
+    case 0:  return (discs << 1) & notA;   // east
+    case 1:  return (discs >> 1) & notH;   // west
+    case 2:  return discs << 8;            // south
+    case 3:  return discs >> 8;            // north
+    case 4:  return (discs << 9) & notA;   // south east
+    case 5:  return (discs << 7) & notH;   // south west
+    case 6:  return (discs >> 7) & notA;   // north east
+    default: return (discs >> 9) & notH;   // north west
+    }
+}
 
-            minScan[i] = curMin;
-            maxScan[i] = curMax;
+unsigned long long othelloMoves(unsigned long long player, unsigned long long opponent)
+{
+    unsigned long long empty = ~(player | opponent);
+    unsigned long long moves = 0;
+    for (int dir = 0; dir < 8; dir++)
+    {
+        unsigned long long run = othelloShift(player, dir) & opponent;
+        for (int i = 0; i < 5; i++)
+            run |= othelloShift(run, dir) & opponent;
+        moves |= othelloShift(run, dir) & empty;
+    }
+    return moves;
+}
 
-            // this node was expected to be less than the PV node value
-            if (expectedMore[i] == false)
-            {
-                if (currentNodeVals[i] <= curMin)
-                {
-                    // reject this branch (i.e, no need to evaluate any more siblings)
-                    nRejected++;
-                    ignored[i] = true;
-                }
-                if (currentNodeVals[i] > curMax)
+int countBits(unsigned long long bits)
+{
+    int count = 0;
+    for (; bits; bits &= bits - 1)
+        count++;
+    return count;
+}
+
+int generateMoves(const Othello &pos, int *moves)
+{
+    // corners first, then the edges and the middle, the squares next to the corners last
+    static const unsigned char order[64] =
+    {
+        0, 7, 56, 63,
+        2, 5, 16, 23, 40, 47, 58, 61, 3, 4, 24, 31, 32, 39, 59, 60,
+        18, 21, 42, 45, 19, 20, 26, 29, 34, 37, 43, 44, 27, 28, 35, 36,
+        10, 11, 12, 13, 17, 22, 25, 30, 33, 38, 41, 46, 50, 51, 52, 53,
+        1, 6, 8, 15, 48, 55, 57, 62, 9, 14, 49, 54,
+    };
+
+    unsigned long long legal = othelloMoves(pos.player, pos.opponent);
+    if (!legal)
+    {
+        if (!othelloMoves(pos.opponent, pos.player))
+            return 0;
+        moves[0] = OTHELLO_PASS;
+        return 1;
+    }
+
+    int nMoves = 0;
+    for (int i = 0; i < 64; i++)
+    {
+        if (legal & (1ULL << order[i]))
+            moves[nMoves++] = order[i];
+    }
+    return nMoves;
+}
+
+void makeMove(Othello &pos, int square)
+{
+    if (square != OTHELLO_PASS)
+    {
+        unsigned long long disc = 1ULL << square;
+        unsigned long long flips = 0;
+        for (int dir = 0; dir < 8; dir++)
+        {
+            unsigned long long run = 0;
+            unsigned long long next = othelloShift(disc, dir);
+            while (next & pos.opponent)
+            {
+                run |= next;
+                next = othelloShift(next, dir);
+            }
+            if (next & pos.player)
+                flips |= run;
+        }
+        pos.player |= disc | flips;
+        pos.opponent &= ~flips;
+    }
+
+    unsigned long long t = pos.player;
+    pos.player = pos.opponent;
+    pos.opponent = t;
+}
+
+int evaluate(const Othello &pos)
+{
+    const unsigned long long corners = 0x8100000000000081ULL;
+    int discs = countBits(pos.player) - countBits(pos.opponent);
+    int mobility = countBits(othelloMoves(pos.player, pos.opponent));
+    int opponentMobility = countBits(othelloMoves(pos.opponent, pos.player));
+
+    if (!mobility && !opponentMobility)
+        return discs > 0 ? OTHELLO_WIN + discs : discs < 0 ? -OTHELLO_WIN + discs : 0;
+
+    int cornerDiscs = countBits(pos.player & corners) - countBits(pos.opponent & corners);
+    return 100 * cornerDiscs + 10 * (mobility - opponentMobility) + discs;
+}
+
+// a finished game above the leaf depth, see above
+void genGameOverLine(Node *node, int depth, int ply, Score rootVal)
+{
+    node->id = gTotalNodes++;
+    node->isMaxNode = ply % 2 == 0;
+
+    if (depth == 0)
+    {
+        gLeafNodes++;
+        node->nodeVal = rootVal;
+        return;
+    }
+
+    Node *child = (Node *) calloc(1, sizeof(Node));
+    child->parent = node;
+    node->nChildren = 1;
+    node->children = child;
+    genGameOverLine(child, depth - 1, ply + 1, rootVal);
+}
+
+// the game tree of pos to the given depth, see above. The root is a max node
+template <typename Position>
+void genGameTree(Node *node, const Position &pos, int depth, int ply = 0)
+{
+    int moves[MAX_GAME_MOVES];
+    int nMoves = depth ? generateMoves(pos, moves) : 0;
+
+    if (nMoves == 0)
+    {
+        // eval for even plies, -eval for odd plies
+        Score val = scoreFromHundredths(evaluate(pos));
+        genGameOverLine(node, depth, ply, ply % 2 == 0 ? val : -val);
+        return;
+    }
+
+    node->id = gTotalNodes++;
+    node->isMaxNode = ply % 2 == 0;
+
+    Node *children = (Node *) calloc(nMoves, sizeof(Node));
+    for (int i = 0; i < nMoves; i++)
+    {
+        children[i].parent = node;
+
+        Position next = pos;
+        makeMove(next, moves[i]);
+        genGameTree(&children[i], next, depth - 1, ply + 1);
+    }
+    node->nChildren = nMoves;
+    node->children = children;
+}
+
+// alphabeta() on the positions of a game, without building the tree. bestMove (if not NULL) gets the
+// index of the best move in generateMoves() order
+template <typename Position>
+Score gameAlphabeta(const Position &pos, int depth, Score alpha, Score beta, int *bestMove = NULL)
+{
+    int moves[MAX_GAME_MOVES];
+    int nMoves = depth ? generateMoves(pos, moves) : 0;
+    if (nMoves == 0)
+    {
+        gLeafNodesVisited++;
+        return scoreFromHundredths(evaluate(pos));
+    }
+
+    gInteriorNodesVisited++;
+
+    int best = 0;
+    for (int i = 0; i < nMoves; i++)
+    {
+        Position next = pos;
+        makeMove(next, moves[i]);
+        Score curScore = -gameAlphabeta(next, depth - 1, -beta, -alpha);
+
+        if (curScore >= beta)
+        {
+            if (bestMove)
+                *bestMove = i;
+            return beta;
+        }
+
+        if (curScore > alpha)
+        {
+            alpha = curScore;
+            best = i;
+        }
+    }
+
+    if (bestMove)
+        *bestMove = best;
+    return alpha;
+}
+
+// a position after nMoves random moves from pos (fewer if the game ends)
+template <typename Position>
+Position randomGamePosition(Position pos, int nMoves)
+{
+    int moves[MAX_GAME_MOVES];
+    for (int i = 0; i < nMoves; i++)
+    {
+        int n = generateMoves(pos, moves);
+        if (!n)
+            break;
+        makeMove(pos, moves[rand() % n]);
+    }
+    return pos;
+}
+
+// alpha-beta under the current budget with the root children searched one by one: if the budget runs out the
+// child being searched is discarded and the best completed one is reported. The value is then a lower bound
+Score alphabetaRootChildren(Node *node, int depth, int *bestChild)
+{
+    Score alpha = -INF;
+    *bestChild = 0;
+    for (int i = 0; i < node->nChildren; i++)
+    {
+        Score curScore = -alphabetaT<true>(&node->children[i], depth - 1, depth, -INF, -alpha);
+        if (gSearchStopped)
+            break;
+
+        if (curScore > alpha)
+        {
+            alpha = curScore;
+            *bestChild = i;
+        }
+    }
+    return alpha;
+}
+
+// anytime alpha-beta, see alphabetaRootChildren()
+SearchResult alphabetaAnytime(Node *node, int depth, const SearchBudget *budget)
+{
+    SearchResult result;
+    START_TIMER
+    startBudget(budget);
+    gLeafNodesVisited = gInteriorNodesVisited = 0;
+    budgetThreadStart();
+
+    int bestChild;
+    Score alpha = alphabetaRootChildren(node, depth, &bestChild);
+
+    result.completed = !endBudget();
+    result.value = alpha;
+    result.bestChild = bestChild;
+    result.nodes = gLeafNodesVisited + gInteriorNodesVisited + 1;
+    if (result.completed)
+    {
+        nodeState(node)->nodeVal = alpha;
+        nodeState(node)->bestChild = bestChild;
+    }
+    STOP_TIMER
+    result.time = gTime;
+
+    return result;
+}
+
+// Incremental re-search
+//
+// initIncrementalSearch() runs alpha-beta once and keeps in the state of every visited node the bound its search
+// returned. updateLeafValue() then changes leaf values in place and marks the path to the root dirty, and
+// incrementalSearch() recomputes the root value and PV: a node that isn't dirty reuses its bound when that
+// decides the window it is searched with, everything else is searched again (with the same reuse below it).
+// All of it with the calling thread's search state: running any other search with that state overwrites the
+// stored values, call initIncrementalSearch() again after.
+
+void clearSearchBounds(Node *node, int depth)
+{
+    nodeState(node)->dirty = false;
+    nodeState(node)->searchBound = BOUND_NONE;
+    if (depth == 0)
+        return;
+
+    for (int i = 0; i < node->nChildren; i++)
+        clearSearchBounds(&node->children[i], depth - 1);
+}
+
+Score alphabetaIncremental(Node *node, int depth, int origDepth, Score alpha, Score beta)
+{
+    if (depth == 0)
+    {
+        gLeafNodesVisited++;
+
+        if (origDepth % 2 == 0)
+            return evaluateLeaf(node);
+        else
+            return -evaluateLeaf(node);
+    }
+
+    NodeState *state = nodeState(node);
+    if (!state->dirty)
+    {
+        if (state->searchBound == BOUND_EXACT)
+            return state->nodeVal;
+        if (state->searchBound == BOUND_LOWER && state->nodeVal >= beta)
+            return beta;
+        if (state->searchBound == BOUND_UPPER && state->nodeVal <= alpha)
+            return alpha;
+    }
+
+    gInteriorNodesVisited++;
+
+    Score origAlpha = alpha;
+    int bestChild = 0;
+
+    for (int i = 0; i < node->nChildren; i++)
+    {
+        Score curScore = -alphabetaIncremental(&node->children[i], depth - 1, origDepth, -beta, -alpha);
+
+        if (curScore >= beta)
+        {
+            // children after this one may still be dirty, they are searched when they matter
+            state->nodeVal = beta;
+            state->searchBound = BOUND_LOWER;
+            state->dirty = false;
+            state->bestChild = i;
+            return beta;
+        }
+
+        if (curScore > alpha)
+        {
+            alpha = curScore;
+            bestChild = i;
+        }
+    }
+
+    state->nodeVal = alpha;
+    state->searchBound = alpha > origAlpha ? BOUND_EXACT : BOUND_UPPER;
+    state->dirty = false;
+    if (alpha > origAlpha)
+        state->bestChild = bestChild;
+
+    return alpha;
+}
+
+Score initIncrementalSearch(Node *root, int depth)
+{
+    TRACE_SCOPE("initIncrementalSearch");
+    clearSearchBounds(root, depth);
+    gLeafNodesVisited = gInteriorNodesVisited = 0;
+    return alphabetaIncremental(root, depth, depth, -INF, INF);
+}
+
+// the value of the leaf is from the point of view of the max player, like the ones from genTree(). Not while
+// other searches run on the tree
+void updateLeafValue(Node *leaf, Score val)
+{
+    leaf->nodeVal = val;
+
+    // all the way up: an ancestor of a dirty node isn't dirty if its last search cut off before reaching it
+    for (Node *node = leaf->parent; node; node = node->parent)
+        nodeState(node)->dirty = true;
+}
+
+Score incrementalSearch(Node *root, int depth)
+{
+    TRACE_SCOPE("incrementalSearch");
+    gLeafNodesVisited = gInteriorNodesVisited = 0;
+    return alphabetaIncremental(root, depth, depth, -INF, INF);
+}
+
+// follows bestChild from the root of a tree searched by alphabeta() or incrementalSearch(), returns the length
+int getPV(Node *root, int depth, int *pv)
+{
+    Node *node = root;
+    for (int d = 0; d < depth; d++)
+    {
+        pv[d] = nodeState(node)->bestChild;
+        node = &node->children[pv[d]];
+    }
+    return depth;
+}
+
+// follows best from the root of a tree searched by exploreTree(), returns the length
+int getBestPointerPV(Node *root, int depth, int *pv)
+{
+    Node *node = root;
+    int d = 0;
+    for (; d < depth && nodeState(node)->best; d++)
+    {
+        pv[d] = (int) (nodeState(node)->best - node->children);
+        node = nodeState(node)->best;
+    }
+    return d;
+}
+
+// random leaf of the subtree of depth 'depth' under node
+Node *randomLeaf(Node *node, int depth)
+{
+    for (int d = 0; d < depth; d++)
+        node = &node->children[rand() % node->nChildren];
+    return node;
+}
+
+// Advancing the root
+//
+// advanceRoot() makes root child 'child' the new root once its move is played. The siblings are freed and the
+// chosen subtree is kept with whatever the last search (the calling thread's search state) left in it, then grown
+// by one ply at the leaves so the next search is 'depth' deep again. The engines all take the side to move at the
+// root as the max player, so the isMaxNode flags are flipped; the negamax values and bounds kept in the states
+// don't depend on that. The nodes are numbered again from 0 and the calling thread's state is replaced by one
+// for the new numbering, other states of the old tree don't apply anymore.
+// The best child (or refutation) each node got from the last search is then moved to the front of its
+// children, where every engine looks first: that's how alphabeta(), exploreTree() and the others warm start.
+// The ancestors of the regrown leaves are marked dirty for incrementalSearch(): their kept bounds are for the
+// tree before it grew. With every old leaf regrown that's all of the kept nodes, so what carries over in
+// practice is the move ordering.
+// Only for trees from genTree(), the siblings are released with freeTree().
+
+void regrowSubTree(Node *node, int depth)
+{
+    bool isMaxNode = !node->isMaxNode;
+
+    if (depth == 0)
+    {
+        // old leaf, gets a ply of new leaves. genTree() takes the parity from g_depth, which is only right when
+        // the new root is where the old one was, so set it from the node's
+        genTree(node, 1);
+        node->isMaxNode = isMaxNode;
+        for (int i = 0; i < node->nChildren; i++)
+            node->children[i].isMaxNode = !isMaxNode;
+        return;
+    }
+
+    node->isMaxNode = isMaxNode;
+    for (int i = 0; i < node->nChildren; i++)
+        regrowSubTree(&node->children[i], depth - 1);
+}
+
+// numbers the nodes below node from *nextId on, moving the states of the ones that were in oldStates (the ones
+// with ids below nOldStates) to states. The others are new, their ancestors are marked dirty. Returns true if
+// there are new nodes below node (or it is one)
+bool renumberSubTree(Node *node, NodeState *oldStates, int nOldStates, NodeState *states, int *nextId)
+{
+    int id = (*nextId)++;
+    bool isNew = node->id >= nOldStates;
+    if (!isNew)
+    {
+        states[id] = oldStates[node->id];
+
+        // the children arrays stay where they are, but check the pointer belongs to them
+        Node *best = states[id].best;
+        if (best && (best < node->children || best >= node->children + node->nChildren))
+            states[id].best = NULL;
+
+        // an exploreTree() frontier position doesn't mean anything in the next tree
+        states[id].frontierOffset = 0;
+        states[id].numChildrenAtFrontier = 0;
+    }
+    node->id = id;
+
+    bool changed = isNew;
+    for (int i = 0; i < node->nChildren; i++)
+        if (renumberSubTree(&node->children[i], oldStates, nOldStates, states, nextId))
+            changed = true;
+
+    if (changed && !isNew)
+        states[id].dirty = true;
+    return changed;
+}
+
+void moveBestChildrenFirst(Node *node, int depth)
+{
+    if (depth <= 1)
+        return;
+
+    NodeState *state = nodeState(node);
+    int best = state->bestChild;
+    if (best != 0 && best < node->nChildren)
+    {
+        Node tmp = node->children[0];
+        node->children[0] = node->children[best];
+        node->children[best] = tmp;
+
+        Node *moved[2] = { &node->children[0], &node->children[best] };
+        for (int k = 0; k < 2; k++)
+            for (int i = 0; i < moved[k]->nChildren; i++)
+                moved[k]->children[i].parent = moved[k];
+    }
+    state->bestChild = 0;
+    state->best = &node->children[0];
+
+    for (int i = 0; i < node->nChildren; i++)
+        moveBestChildrenFirst(&node->children[i], depth - 1);
+}
+
+void advanceRoot(Node *root, int child, int depth, bool warmStart = true)
+{
+    TRACE_SCOPE("advanceRoot");
+    for (int i = 0; i < root->nChildren; i++)
+        if (i != child)
+            freeTree(&root->children[i]);
+
+    Node *oldChildren = root->children;
+    *root = oldChildren[child];
+    free(oldChildren);
+
+    root->parent = NULL;
+    for (int i = 0; i < root->nChildren; i++)
+        root->children[i].parent = root;
+
+    // the ids of the new leaves and of their parents (the old leaves) are new, their states start out empty
+    int nOldStates = gNodeStates ? gTotalNodes : 0;
+    gLeafNodes = 0;
+    regrowSubTree(root, depth - 1);
+
+    NodeState *states = (NodeState *) calloc(gTotalNodes, sizeof(NodeState));
+    int nNodes = 0;
+    renumberSubTree(root, gNodeStates, nOldStates, states, &nNodes);
+    free(gNodeStates);
+    gNodeStates = (NodeState *) realloc(states, nNodes * sizeof(NodeState));
+    gTotalNodes = nNodes;
+
+    if (warmStart)
+        moveBestChildrenFirst(root, depth);
+}
+
+// Multi-PV
+//
+// the best K root children with exact scores. The K best found so far are kept sorted, the K-th of them is the
+// bound the remaining children have to beat, so they're searched with the window (bound, INF) and most of them
+// fail low quickly. multiPVIndependent() is the naive version for comparison: K full searches, each one
+// excluding the children already reported.
+
+#define MAX_PV 16
+
+struct MultiPV
+{
+    int   nMoves;
+    int   child[MAX_PV];    // best first
+    Score score[MAX_PV];
+    int   nodes;
+};
+
+void multiPVInsert(MultiPV *pv, int K, int child, Score score)
+{
+    int i = min(pv->nMoves, K - 1);
+    while (i > 0 && pv->score[i - 1] < score)
+    {
+        pv->child[i] = pv->child[i - 1];
+        pv->score[i] = pv->score[i - 1];
+        i--;
+    }
+    pv->child[i] = child;
+    pv->score[i] = score;
+    pv->nMoves = min(pv->nMoves + 1, K);
+}
+
+void multiPVAlphabeta(Node *root, int depth, int K, MultiPV *pv)
+{
+    TRACE_SCOPE("multiPVAlphabeta");
+    K = min(min(K, MAX_PV), (int) root->nChildren);
+    pv->nMoves = 0;
+    gLeafNodesVisited = gInteriorNodesVisited = 0;
+
+    for (int i = 0; i < root->nChildren; i++)
+    {
+        Score bound = pv->nMoves < K ? -INF : pv->score[K - 1];
+        Score curScore = -alphabeta(&root->children[i], depth - 1, depth, -INF, -bound);
+        if (curScore > bound)
+            multiPVInsert(pv, K, i, curScore);
+    }
+
+    nodeState(root)->nodeVal = pv->score[0];
+    nodeState(root)->bestChild = pv->child[0];
+    pv->nodes = gLeafNodesVisited + gInteriorNodesVisited + 1;
+}
+
+void multiPVIndependent(Node *root, int depth, int K, MultiPV *pv)
+{
+    TRACE_SCOPE("multiPVIndependent");
+    K = min(min(K, MAX_PV), (int) root->nChildren);
+    pv->nMoves = 0;
+    gLeafNodesVisited = gInteriorNodesVisited = 0;
+
+    bool excluded[MAX_BRANCHING + 1] = { false };
+    for (int k = 0; k < K; k++)
+    {
+        Score alpha = -INF;
+        int bestChild = -1;
+        for (int i = 0; i < root->nChildren; i++)
+        {
+            if (excluded[i])
+                continue;
+
+            Score curScore = -alphabeta(&root->children[i], depth - 1, depth, -INF, -alpha);
+            if (curScore > alpha || bestChild < 0)
+            {
+                alpha = curScore;
+                bestChild = i;
+            }
+        }
+
+        excluded[bestChild] = true;
+        pv->child[k] = bestChild;
+        pv->score[k] = alpha;
+        pv->nMoves++;
+    }
+
+    pv->nodes = gLeafNodesVisited + gInteriorNodesVisited + K;
+}
+
+// simple root splitting parallel alpha-beta (reference for the parallel best-first searches)
+// the first root child is searched serially with the full window to get a bound, the remaining
+// root children are handed out to the worker threads one at a time, each searched with the best
+// bound known when it is picked up
+int gParallelABNodes = 0;
+
+struct ParallelABState
+{
+    Node *root;
+    int depth;
+    std::atomic<int> nextChild;
+    std::mutex lock;            // protects alpha and bestChild
+    Score alpha;
+    int bestChild;
+    std::atomic<int> nodes;
+
+    // when the tree was built by genTreePlaced(), root child i lives on NUMA node i % nNumaNodes
+    int nNumaNodes;                                 // 0: no placement, children handed out in order
+    std::atomic<int> nextOnNode[MAX_NUMA_NODES];    // next root child on each node is node + k * nNumaNodes
+};
+
+// next root child for a worker running on numaNode: the ones on its own node first, then the rest
+int nextRootChild(ParallelABState *state, int numaNode)
+{
+    if (!state->nNumaNodes)
+        return state->nextChild++;
+
+    for (int n = 0; n < state->nNumaNodes; n++)
+    {
+        int node = (numaNode + n) % state->nNumaNodes;
+        int i = node + state->nextOnNode[node]++ * state->nNumaNodes;
+        if (i < state->root->nChildren)
+            return i;
+    }
+
+    return state->root->nChildren;
+}
+
+// searches one root child, with the budget check if a budget is set
+Score parallelABSearchChild(ParallelABState *state, int i, Score alpha)
+{
+    TRACE_SCOPE("root child");
+    Node *child = &state->root->children[i];
+    if (gBudget)
+        return -alphabetaT<true>(child, state->depth - 1, state->depth, -INF, -alpha);
+    else
+        return -alphabetaT<false>(child, state->depth - 1, state->depth, -INF, -alpha);
+}
+
+void parallelAlphabetaWorker(ParallelABState *state, int t)
+{
+    TRACE_SCOPE("parallel alpha-beta worker");
+    gLeafNodesVisited = gInteriorNodesVisited = 0;
+    budgetThreadStart();
+
+    int numaNode = 0;
+    if (state->nNumaNodes)
+    {
+        numaNode = t % state->nNumaNodes;
+        bindThreadToNumaNode(numaNode);
+    }
+
+    Node *root = state->root;
+    int i;
+    while ((i = nextRootChild(state, numaNode)) < root->nChildren)
+    {
+        Score alpha;
+        {
+            std::lock_guard<std::mutex> guard(state->lock);
+            alpha = state->alpha;
+        }
+
+        Score curScore = parallelABSearchChild(state, i, alpha);
+        if (gSearchStopped)
+            break;
+
+        std::lock_guard<std::mutex> guard(state->lock);
+        if (curScore > state->alpha)
+        {
+            state->alpha = curScore;
+            state->bestChild = i;
+        }
+    }
+
+    state->nodes += gLeafNodesVisited + gInteriorNodesVisited;
+}
+
+// nNumaNodes: number of NUMA nodes the tree was placed on by genTreePlaced(), 0 if not placed
+Score parallelAlphabeta(Node *node, int depth, int nThreads, int nNumaNodes = 0)
+{
+    TRACE_SCOPE("parallelAlphabeta");
+    ParallelABState state;
+    state.root = node;
+    state.depth = depth;
+    state.bestChild = 0;
+    state.nodes = 1;
+    state.nNumaNodes = nNumaNodes;
+    for (int n = 0; n < MAX_NUMA_NODES; n++)
+        state.nextOnNode[n] = (n == 0) ? 1 : 0;     // child 0 is searched first, below
+
+    gLeafNodesVisited = gInteriorNodesVisited = 0;
+    budgetThreadStart();
+    state.alpha = -INF;
+    Score firstScore = parallelABSearchChild(&state, 0, -INF);
+    if (!gSearchStopped)
+        state.alpha = firstScore;
+    state.nodes += gLeafNodesVisited + gInteriorNodesVisited;
+    state.nextChild = gSearchStopped ? node->nChildren : 1;
+
+    std::thread workers[MAX_THREADS];
+    for (int t = 0; t < nThreads; t++)
+        workers[t] = searchThread(parallelAlphabetaWorker, &state, t);
+    for (int t = 0; t < nThreads; t++)
+        workers[t].join();
+
+    nodeState(node)->nodeVal = state.alpha;
+    nodeState(node)->bestChild = state.bestChild;
+    gParallelABNodes = state.nodes;
+
+    return state.alpha;
+}
+
+// anytime version, the value is a lower bound if the search was stopped
+SearchResult parallelAlphabetaAnytime(Node *node, int depth, int nThreads, const SearchBudget *budget)
+{
+    SearchResult result;
+    START_TIMER
+    startBudget(budget);
+    result.value = parallelAlphabeta(node, depth, nThreads);
+    result.completed = !endBudget();
+    result.bestChild = nodeState(node)->bestChild;
+    result.nodes = gParallelABNodes;
+    STOP_TIMER
+    result.time = gTime;
+
+    return result;
+}
+
+// Lazy SMP
+//
+// nThreads plain alpha-beta searches of the same root sharing a table of bounds, the first one to finish has
+// the answer and stops the others. The helper threads go through the children of the top LAZY_SMP_ORDER_PLIES
+// plies in rotated orders so they start out in different subtrees, and the bounds each one stores make the
+// others' searches of the same nodes cheaper. The table has no locks: an entry is two 64 bit words, the data
+// and the node's address xor'ed with the data, so an entry torn by concurrent writes just doesn't match.
+// (The usual depth offsets between the threads don't apply here: interior nodes have no eval to stop at.)
+
+#define LAZY_SMP_TABLE_BITS  20
+#define LAZY_SMP_ORDER_PLIES 3
+
+struct BoundEntry
+{
+    std::atomic<unsigned long long> check;  // node address ^ data
+    std::atomic<unsigned long long> data;   // bound type << 32 | value bits
+};
+
+struct LazySMPStats
+{
+    int    nodes;
+    int    tableHits;       // nodes whose search was replaced by a stored bound
+    bool   finishedFirst;
+    double time;            // ms, until the thread finished or noticed it was beaten
+};
+
+struct LazySMPState
+{
+    Node *root;
+    int depth;
+    BoundEntry *table;
+    unsigned mask;
+    std::atomic<bool> done;
+    Score result;
+    int bestChild;
+    LazySMPStats stats[MAX_THREADS];
+};
+
+LazySMPStats gLazySMPStats[MAX_THREADS];
+int gLazySMPNodes = 0;
+
+static inline BoundEntry *lazySMPEntry(LazySMPState *state, Node *node)
+{
+    return &state->table[(unsigned) ((size_t) node / sizeof(Node)) & state->mask];
+}
+
+void lazySMPStore(LazySMPState *state, Node *node, int boundType, Score value)
+{
+    unsigned int bits = 0;
+    memcpy(&bits, &value, sizeof(Score));
+    unsigned long long data = ((unsigned long long) boundType << 32) | bits;
+
+    BoundEntry *entry = lazySMPEntry(state, node);
+    entry->check.store((unsigned long long) (size_t) node ^ data, std::memory_order_relaxed);
+    entry->data.store(data, std::memory_order_relaxed);
+}
+
+// stats are the thread's own copy, not the ones in state which share cache lines
+Score lazySMPSearch(LazySMPState *state, int t, LazySMPStats *stats, Node *node, int depth, int ply, Score alpha, Score beta)
+{
+    stats->nodes++;
+
+    if (depth == 0)
+    {
+        // eval for even depths, -eval for odd depths
+        if (state->depth % 2 == 0)
+            return evaluateLeaf(node);
+        else
+            return -evaluateLeaf(node);
+    }
+
+    // beaten by another thread, nothing gets stored on the way up
+    if (state->done.load(std::memory_order_relaxed))
+        return alpha;
+
+    BoundEntry *entry = lazySMPEntry(state, node);
+    unsigned long long data = entry->data.load(std::memory_order_relaxed);
+    if ((entry->check.load(std::memory_order_relaxed) ^ data) == (unsigned long long) (size_t) node)
+    {
+        Score value;
+        unsigned int bits = (unsigned int) data;
+        memcpy(&value, &bits, sizeof(Score));
+        int boundType = (int) (data >> 32);
+
+        if (boundType == BOUND_EXACT || (boundType == BOUND_LOWER && value >= beta) || (boundType == BOUND_UPPER && value <= alpha))
+        {
+            stats->tableHits++;
+            return min(max(value, alpha), beta);
+        }
+    }
+
+    Score origAlpha = alpha;
+    int n = node->nChildren;
+    int rot = ply < LAZY_SMP_ORDER_PLIES ? t % n : 0;
+
+    for (int k = 0; k < n; k++)
+    {
+        int i = k + rot < n ? k + rot : k + rot - n;
+        Score curScore = -lazySMPSearch(state, t, stats, &node->children[i], depth - 1, ply + 1, -beta, -alpha);
+
+        if (state->done.load(std::memory_order_relaxed))
+            return alpha;
+
+        if (curScore >= beta)
+        {
+            lazySMPStore(state, node, BOUND_LOWER, beta);
+            return beta;
+        }
+
+        if (curScore > alpha)
+            alpha = curScore;
+    }
+
+    lazySMPStore(state, node, alpha > origAlpha ? BOUND_EXACT : BOUND_UPPER, alpha);
+    return alpha;
+}
+
+void lazySMPWorker(LazySMPState *state, int t)
+{
+    TRACE_SCOPE("lazy SMP worker");
+    LazySMPStats stats = { 0 };
+    LARGE_INTEGER start, end, ticksPerSecond;
+    QueryPerformanceFrequency(&ticksPerSecond);
+    QueryPerformanceCounter(&start);
+
+    Node *root = state->root;
+    int n = root->nChildren;
+    int rot = t % n;
+    Score alpha = -INF;
+    int bestChild = 0;
+    stats.nodes = 1;
+
+    for (int k = 0; k < n; k++)
+    {
+        int i = k + rot < n ? k + rot : k + rot - n;
+        Score curScore = -lazySMPSearch(state, t, &stats, &root->children[i], state->depth - 1, 1, -INF, -alpha);
+
+        if (state->done.load(std::memory_order_relaxed))
+            break;
+
+        if (curScore > alpha)
+        {
+            alpha = curScore;
+            bestChild = i;
+        }
+    }
+
+    bool expected = false;
+    if (state->done.compare_exchange_strong(expected, true))
+    {
+        state->result = alpha;
+        state->bestChild = bestChild;
+        stats.finishedFirst = true;
+    }
+
+    QueryPerformanceCounter(&end);
+    stats.time = ((double)(end.QuadPart - start.QuadPart) * 1000.0) / ticksPerSecond.QuadPart;
+    state->stats[t] = stats;
+}
+
+Score lazySMP(Node *root, int depth, int nThreads)
+{
+    TRACE_SCOPE("lazySMP");
+    LazySMPState *state = new LazySMPState();
+    state->root = root;
+    state->depth = depth;
+    state->mask = (1 << LAZY_SMP_TABLE_BITS) - 1;
+    // all zero is an empty table (no node is at address 0), calloc only maps the pages when they're touched
+    state->table = (BoundEntry *) calloc(1 << LAZY_SMP_TABLE_BITS, sizeof(BoundEntry));
+    state->done = false;
+    memset(state->stats, 0, sizeof(state->stats));
+
+    std::thread workers[MAX_THREADS];
+    for (int t = 0; t < nThreads; t++)
+        workers[t] = std::thread(lazySMPWorker, state, t);
+    for (int t = 0; t < nThreads; t++)
+        workers[t].join();
+
+    gLazySMPNodes = 0;
+    for (int t = 0; t < nThreads; t++)
+    {
+        gLazySMPStats[t] = state->stats[t];
+        gLazySMPNodes += state->stats[t].nodes;
+    }
+
+    Score val = state->result;
+    nodeState(root)->nodeVal = val;
+    nodeState(root)->bestChild = state->bestChild;
+
+    free(state->table);
+    delete state;
+    return val;
+}
+
+bool isBetter(Node *node, Score val)
+{
+    if (node->isMaxNode && val > nodeState(node)->nodeVal)
+        return true;
+
+    if ((!node->isMaxNode) && (val < nodeState(node)->nodeVal))
+        return true;
+
+    return false;
+}
+
+// returns true if val1 is better than val2
+bool isBetter(bool isMaxNode, Score val1, Score val2)
+{
+    if (isMaxNode && (val1 > val2))
+        return true;
+
+    if ((!isMaxNode) && (val1 < val2))
+        return true;
+
+    return false;
+}
+
+// Wide nodes
+//
+// With hundreds or thousands of children the loops over a node's children dominate exploreTree(). The best
+// child is found with separate running bests for every 4th child, so the compares don't wait on each other,
+// and then looked up. expandNode()'s sibling check goes through each sibling's frontier entries (which are
+// contiguous) with branch free loops that the compiler vectorizes.
+
+#define WIDE_NODE_CHILDREN 16
+
+// sets node's value, best and bestChild from its children's values (leaves): the max (or min), the first one on ties
+void reduceChildren(Node *node, bool isMax)
+{
+    Node *children = node->children;
+    int n = node->nChildren;
+    Score sign = isMax ? 1 : -1;    // max of the signed values
+    int best = 0;
+
+    // evaluated up front, the loops below only compare the values
+    if (gLeafCostModel != LEAF_COST_NONE)
+    {
+        for (int k = 0; k < n; k++)
+            payLeafCost(children[k].id);
+    }
+
+    if (n < WIDE_NODE_CHILDREN)
+    {
+        for (int k = 1; k < n; k++)
+        {
+            if (sign * children[k].nodeVal > sign * children[best].nodeVal)
+                best = k;
+        }
+    }
+    else
+    {
+        Score m0 = -INF, m1 = -INF, m2 = -INF, m3 = -INF;
+        int k = 0;
+        for (; k + 4 <= n; k += 4)
+        {
+            m0 = max(m0, (Score) (sign * children[k].nodeVal));
+            m1 = max(m1, (Score) (sign * children[k + 1].nodeVal));
+            m2 = max(m2, (Score) (sign * children[k + 2].nodeVal));
+            m3 = max(m3, (Score) (sign * children[k + 3].nodeVal));
+        }
+        for (; k < n; k++)
+            m0 = max(m0, (Score) (sign * children[k].nodeVal));
+
+        Score top = max(max(m0, m1), max(m2, m3));
+        while (sign * children[best].nodeVal != top)
+            best++;
+    }
+
+    NodeState *state = nodeState(node);
+    state->nodeVal = children[best].nodeVal;
+    state->best = &children[best];
+    state->bestChild = best;
+}
+
+// marks the frontier entries in [begin, end) that aren't better than val as ignored, returns true if
+// one of them (not ignored before) is better. lastIgnored as for expandNode()
+bool ignoreWorseEntries(Score *currentNodeVals, bool *ignored, int begin, int end, bool isMax, Score val,
+                        int *lastIgnored)
+{
+    Score sign = isMax ? 1 : -1;
+    Score signedVal = sign * val;
+    bool anyBetter = false;
+    int last = -1;
+    for (int k = begin; k < end; k++)
+    {
+        bool better = sign * currentNodeVals[k] > signedVal;
+        bool newlyIgnored = !ignored[k] & !better;
+        anyBetter |= !ignored[k] & better;
+        last = newlyIgnored ? k : last;
+        ignored[k] |= !better;
+    }
+
+    if (lastIgnored && last > *lastIgnored)
+        *lastIgnored = last;
+    return anyBetter;
+}
+
+int propogateFrontierOffsets(Node *node, int *childrenAtFrontier)
+{
+    NodeState *state = nodeState(node);
+    if (state->numChildrenAtFrontier)
+    {
+        *childrenAtFrontier = state->numChildrenAtFrontier;
+        return state->frontierOffset;
+    }
+
+    assert(node->nChildren > 0);
+    int last, count;
+    int first = propogateFrontierOffsets(&node->children[0], &count);
+    if (state->nChildsExplored > 1)
+    {
+        for (int i = 1; i < state->nChildsExplored; i++)
+        {
+            last = propogateFrontierOffsets(&node->children[i], &count);
+        }
+        last += count;
+        count = last - first;
+    }
+
+    state->frontierOffset = first;
+    state->numChildrenAtFrontier = count;
+
+    *childrenAtFrontier = count;
+
+    return first;
+}
+
+// per thread, exploreSubTree() also runs on the speculative expansion threads
+thread_local int exploreSubTreeCount = 0;
+
+struct ExpansionSpeculation;
+bool expandNode(Node **fullCurrentFrontier, Score *currentNodeVals, int i, Score curBest, Node *subTreeRoot, bool *ignored,
+                ExpansionSpeculation *spec, int *lastIgnored = NULL);
+Score exploreSiblingSubTree(ExpansionSpeculation *spec, Node *sibling, Score curBest);
+
+// starts exploring a node as if it's a CUT node with cutVal as the value to check against
+// returns either cutVal if a  better value couldn't be found,  or value of the best found node otherwise
+// works only on CUT and ALL nodes, no node is marked as PV node by this function
+Score exploreSubTree(Node *node, Score cutVal)
+{
+    TRACE_SCOPE("exploreSubTree");
+    exploreSubTreeCount++;
+
+    // isMaxLevel is true if node's *parent* is a MAX level
+    bool isMaxLevel = !node->isMaxNode;
+    if (node->children == NULL)
+    {
+        // leaf node
+        Score val = evaluateLeaf(node);
+        return isMaxLevel ? max(cutVal, val) : min(cutVal, val);
+    }
+
+    // full frontier
+    Node **fullCurrentFrontier = NULL;
+    Node **fullNextFrontier = NULL;
+
+    // only for the last level
+    Score *currentNodeVals;
+
+    int nCurr, nNext;
+
+    // treat passed-in node as CUT node
+    nodeState(node)->nodeType = CUT_NODE;
+    fullCurrentFrontier = &node;
+    nCurr = 1;
+
+    bool currentIsMaxLevel = !isMaxLevel;
+    int subDepth = 0;
+    while (1)
+    {
+        bool secondLastLevel = false;
+        secondLastLevel = (fullCurrentFrontier[0]->children[0].children == NULL);
+
+        // explore the frontier nodes
+
+        // figure out total no. of childs that need to be explored for all frontier nodes
+        nNext = 0;
+        for (int j=0; j<nCurr; j++)
+        {
+            switch (nodeState(fullCurrentFrontier[j])->nodeType)
+            {
+                case ALL_NODE:
+                    // if it's the second last level, we will explore all ALL nodes and find the best immediately
+                    nNext += secondLastLevel ? 1 : fullCurrentFrontier[j]->nChildren;
+                    break;
+                case CUT_NODE:
+                    nNext++;
+                    break;
+            }
+        }
+        
+        // no more child nodes, we are at leaves..
+        if (nNext == 0)
+            break;
+
+        if (gBudget)
+            budgetTick(nNext);
+
+        // allocate memory for the next frontier
+        fullNextFrontier = (Node**) malloc (nNext * sizeof(Node *));
+
+        if (secondLastLevel) {
+            assert(nCurr == nNext);
+            currentNodeVals = (Score *)malloc(nNext * sizeof(Score));
+        }
+        
+        int index = 0;
+        // fill in the next frontier
+        for (int j=0; j<nCurr; j++)
+        {
+            switch (nodeState(fullCurrentFrontier[j])->nodeType)
+            {
+                case ALL_NODE:
+                    if (secondLastLevel)
+                    {
+                        Node * curNode = fullCurrentFrontier[j];
+                        reduceChildren(curNode, curNode->isMaxNode);
+                        if (secondLastLevel)
+                            currentNodeVals[index] = nodeState(curNode)->nodeVal;
+                        fullNextFrontier[index++] = curNode;
+                        nodeState(curNode)->nChildsExplored = curNode->nChildren;
+                    }
+                    else
+                    {
+                        for (int k = 0; k < fullCurrentFrontier[j]->nChildren; k++)
+                        {
+                            Node *curNode = &(fullCurrentFrontier[j]->children[k]);
+                            nodeState(curNode)->nodeType = CUT_NODE;   // child of ALL node is cut node
+                            fullNextFrontier[index++] = curNode;
+                        }
+                        nodeState(fullCurrentFrontier[j])->nChildsExplored = fullCurrentFrontier[j]->nChildren;
+                        nodeState(fullCurrentFrontier[j])->best = &(fullCurrentFrontier[j]->children[0]);
+                    }
+                    break;
+                case CUT_NODE:
+                    {
+                        nodeState(fullCurrentFrontier[j])->nChildsExplored = 1;
+                        nodeState(fullCurrentFrontier[j])->best = &(fullCurrentFrontier[j]->children[0]);
+                        nodeState(&fullCurrentFrontier[j]->children[0])->nodeType = ALL_NODE;
+                        fullNextFrontier[index] = &(fullCurrentFrontier[j]->children[0]);
+                        if (secondLastLevel)
+                        {
+                            currentNodeVals[index] = evaluateLeaf(fullNextFrontier[index]);
+                            nodeState(fullCurrentFrontier[j])->nodeVal = currentNodeVals[index];
+                        }
+                        index++;
+                    }
+            }
+
+            if (secondLastLevel)
+            {
+                nodeState(fullNextFrontier[j])->numChildrenAtFrontier = 1;
+                nodeState(fullNextFrontier[j])->frontierOffset = j;
+            }
+        }
+
+        // go to next depth, set current = next
+        if (subDepth != 0)
+            free (fullCurrentFrontier);
+
+        nCurr = nNext;
+        fullCurrentFrontier = fullNextFrontier;
+
+        subDepth++;
+
+        currentIsMaxLevel = !currentIsMaxLevel;
+
+        if (secondLastLevel)
+            break;
+    }
+
+    int count;
+    int start = propogateFrontierOffsets(node, &count);
+    assert(start == 0 && count == nCurr);
+    
+    Score *minScan = (Score *)malloc(sizeof(Score) * nCurr);
+    Score *maxScan = (Score *)malloc(sizeof(Score) * nCurr);
+    bool *ignored = (bool *)malloc(sizeof(bool) * nCurr);
+    memset(ignored, 0, sizeof(bool) * nCurr);
+
+    Score curMin, curMax;
+    curMin = curMax = cutVal;  // init. with cut val
+
+    Score computedVal = isMaxLevel ? -INF : INF;
+
+    int nRejected;
+    int nExpnded;
+
+    do
+    {
+        nRejected = 0;
+        nExpnded = 0;
+
+        curMin = curMax = cutVal;
+
+        for (int i = 0; i < nCurr; i++)
+        {
+            if (gBudget && budgetTick(1))
+                break;
+
+            // all nodes that are explored here must be ALL nodes
+            assert(nodeState(fullCurrentFrontier[i])->nodeType = ALL_NODE ||
+                nodeState(fullCurrentFrontier[i])->nChildsExplored == fullCurrentFrontier[i]->nChildren);
+
+            if (ignored[i])
+                continue;
+
+            minScan[i] = curMin;
+            maxScan[i] = curMax;
+
+            // this node was expected to be less than the PV node value
+            if (isMaxLevel)
+            {
+                if (currentNodeVals[i] <= curMin)
+                {
+                    // reject this branch (i.e, no need to evaluate any more siblings)
+                    nRejected++;
+                    ignored[i] = true;
+                }
+                if (currentNodeVals[i] > curMax)
+                {
+                    curMax = currentNodeVals[i];
+                    // need to evaluate more siblings of this node
+                    if (expandNode(fullCurrentFrontier, currentNodeVals, i, curMax, node, ignored, NULL))
+                        nExpnded++;
+                    computedVal = currentNodeVals[i];
+                }
+            }
+            else //if (!isMaxLevel)
+            {
+                if (currentNodeVals[i] >= curMax)
+                {
+                    // reject this branch (i.e, no need to evaluate any more siblings of this node)
+                    nRejected++;
+                    ignored[i] = true;
+                }
+                if (currentNodeVals[i] < curMin)
+                {
+                    curMin = currentNodeVals[i];
+                    // need to evaluate more siblings of this node
+                    if(expandNode(fullCurrentFrontier, currentNodeVals, i, curMin, node, ignored, NULL))
+                        nExpnded++;
+                    computedVal = currentNodeVals[i];
+                }
+            }
+        }
+
+        // the loop is done when nothing gets expanded anymore (or when the search budget runs out)
+    } while (nExpnded && !gSearchStopped);
+
+    return isMaxLevel ? max(cutVal, computedVal)
+                      : min(cutVal, computedVal);
+}
+
+// returns true if the node was actually expanded (sibling evaluated)
+//         false otherwise (if there are no siblings, or if the node is a PV or subTreeRoot)
+// spec holds the speculatively explored siblings (exploreTree's main loop only, NULL otherwise)
+// lastIgnored (if not NULL) is raised to the highest frontier offset this call newly marked as ignored
+bool expandNode(Node **fullCurrentFrontier, Score *currentNodeVals, int i, Score curBest, Node *subTreeRoot, bool *ignored,
+                ExpansionSpeculation *spec, int *lastIgnored)
+{
+    TRACE_SCOPE("expandNode");
+    Node *thisNode = fullCurrentFrontier[i];
+    bool isMaxLevel = thisNode->isMaxNode;
+
+    // no need to explore any siblings if the current node itself is subtree root!
+    if (thisNode == subTreeRoot)
+        return false;
+
+    Node *parentNode = thisNode->parent;
+
+    assert(nodeState(parentNode)->nodeType == CUT_NODE);
+
+    Node *currentParent = parentNode;
+    while (nodeState(currentParent)->nChildsExplored == currentParent->nChildren)
+    {
+        // break out early if we reached the subTreeRoot!
+        if (currentParent == subTreeRoot)
+        {
+            //if (isBetter(currentParent, currentNodeVals[i]))
+            {
+                nodeState(currentParent)->best = thisNode;
+                nodeState(currentParent)->nodeVal = currentNodeVals[i];
+                nodeState(thisNode)->nodeType = PV_NODE;
+            }
+            return false;
+        }
+        // already explored the last child, need to explore more nodes of GrandParent of Parent node?
+        // parent of parent should be an ALL node, with everything explored already ?
+        nodeState(currentParent)->nodeVal = currentNodeVals[i];
+        thisNode = currentParent;
+        currentParent = currentParent->parent;
+
+        if (nodeState(currentParent)->nodeType == ALL_NODE)
+        {
+            //if (isBetter(currentParent, currentNodeVals[i]))
+
+            // when moving up, only cross an ALL node only when 
+            //  i)  either it's the last child
+            //  ii) there is no 'open' child towards the right of current node
+            //     - open CHILD are the nodes that have possibility of being better than the current node
+            bool isBest = true;
+            // bool onRight = false;
+
+            // TODO: Check only nodes towards the right. No need to check all nodes of parent
+            // ANKAN - BUG! TODO!!! just checking nodes towards right doesn't work. Figure out why?
+
+            for (int n = 0; n < currentParent->nChildren; n++)
+            {
+                if ((&currentParent->children[n]) != thisNode)
+                {
+                    //if (!onRight)
+                    //    continue;
+
+                    // entries that aren't better get ignored, the node isn't the best if any is better
+                    Node *sibling = &currentParent->children[n];
+                    if (ignoreWorseEntries(currentNodeVals, ignored, nodeState(sibling)->frontierOffset,
+                                           nodeState(sibling)->frontierOffset + nodeState(sibling)->numChildrenAtFrontier,
+                                           currentParent->isMaxNode, currentNodeVals[i], lastIgnored))
+                    {
+                        isBest = false;
+                    }
+                    if (!isBest)
+                    {
+                        break;
+                    }
+                }
+                //else
+                //{
+                //    onRight = true;
+                //}
+            }
+
+
+            if (isBest)
+            {
+                nodeState(currentParent)->best = thisNode;
+                nodeState(currentParent)->nodeVal = currentNodeVals[i];
+            }
+            else
+            {
+                // wait for other better nodes to be sorted, out
+                // don't move up
+                return false;
+            }
+        }
+
+        if (nodeState(currentParent)->nodeType == PV_NODE)
+        {
+            // Ankan TODO: might need to propogate up only if it's actually better
+            nodeState(currentParent)->best = thisNode;
+            nodeState(thisNode)->nodeType = PV_NODE;
+
+
+            // nodeState(currentParent)->nodeVal = currentNodeVals[i];
+
+            // need to propogate the value all the way to root!
+            while (currentParent)
+            {
+                nodeState(currentParent)->nodeVal = currentNodeVals[i];
+
+                // stop when the chain of PV nodes breaks!
+                if (nodeState(currentParent)->nodeType != PV_NODE)
+                    break;
+                currentParent = currentParent->parent;
+            }
+
+            return false;
+        }
+    }
+
+    assert(nodeState(currentParent)->nodeType != PV_NODE);
+    {
+        // here we have a parent node with unexplored children, explore one of them
+        //assert(nodeState(currentParent)->nodeType == CUT_NODE);
+        Node *sibling = &(currentParent->children[nodeState(currentParent)->nChildsExplored]);
+        nodeState(sibling)->nodeType = ALL_NODE;
+        nodeState(currentParent)->nChildsExplored++;
+        Score siblingVal = exploreSiblingSubTree(spec, sibling, curBest);
+        if (currentParent->isMaxNode && siblingVal > currentNodeVals[i])
+        {
+            currentNodeVals[i] = siblingVal;
+            nodeState(currentParent)->best = sibling;
+            fullCurrentFrontier[i] = sibling;
+        }
+        if ((!currentParent->isMaxNode) && siblingVal < currentNodeVals[i])
+        {
+            currentNodeVals[i] = siblingVal;
+            nodeState(currentParent)->best = sibling;
+            fullCurrentFrontier[i] = sibling;
+        }
+
+    }
+    nodeState(currentParent)->nodeVal = currentNodeVals[i];
+
+    // propogate the value all the way up if the parent's value was coming from this node
+    Node *cur = currentParent;
+    while (true)
+    {
+        Node *par = cur->parent;
+        if (nodeState(par)->best == cur)
+        {
+            nodeState(par)->nodeVal = nodeState(cur)->nodeVal;
+            cur = par;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    return true;
+}
+
+// Parallel scan formulation of exploreTree's accept/reject loop
+//
+// Within a pass the running bounds only move at expansions: curMax goes up to the value an entry expected to be
+// less than the PV had before it was expanded (curMin down, for the other entries). So as long as no expansion
+// marks entries further ahead as ignored, curMax on reaching entry i is an exclusive max-scan over the values of
+// the active entries expected to be less, curMin a min-scan over the others, and whether an entry gets rejected
+// or expanded follows from comparing it with its scanned bounds. Both are data parallel: every block of the
+// frontier reduces its part, the block totals are scanned serially, and every block then rescans its part from
+// its carry-in, compacting the entries to act on into a list of events.
+// The pass applies the events in order, expandNode() still one at a time as its sibling check reads ignored[]
+// and the values of other entries. When it marks an entry further ahead as ignored the rest of the list is
+// stale and the remaining frontier is scanned again, so passes end up exactly as with the serial loop.
+
+#define FRONTIER_EVENT_EXPAND 1
+
+// scans entries [begin, end) of the frontier starting with the bounds curMin and curMax. minScan[i] and
+// maxScan[i] get the bounds seen on reaching entry i and events gets the entries to act on in frontier order
+// (index << 1, with FRONTIER_EVENT_EXPAND set for expansions). scratch needs room for end - begin ints.
+// The blocks run on the threads of the pool. returns the number of events
+int scanFrontier(Score *currentNodeVals, bool *expectedMore, bool *ignored, int begin, int end, Score curMin, Score curMax,
+                 Score *minScan, Score *maxScan, int *events, int *scratch, WorkerPool *pool)
+{
+    TRACE_SCOPE("scanFrontier");
+    int n = end - begin;
+    if (n <= 0)
+        return 0;
+
+    int nBlocks = parallelBlockCount(n, pool->nThreads);
+    Score blockMin[MAX_THREADS], blockMax[MAX_THREADS];
+    int blockEvents[MAX_THREADS];
+
+    // reduce every block (a single block starts from curMin / curMax right away)
+    if (nBlocks > 1)
+    {
+        parallelBlocks(pool, n, nBlocks, [&](int b, int first, int last)
+        {
+            Score lo = INF, hi = -INF;
+            for (int i = begin + first; i < begin + last; i++)
+            {
+                if (ignored[i])
+                    continue;
+                if (expectedMore[i])
+                    lo = min(lo, currentNodeVals[i]);
+                else
+                    hi = max(hi, currentNodeVals[i]);
+            }
+            blockMin[b] = lo;
+            blockMax[b] = hi;
+        });
+    }
+
+    // exclusive scan of the block totals: every block's carry-in
+    for (int b = 0; b < nBlocks; b++)
+    {
+        Score lo = curMin, hi = curMax;
+        if (b < nBlocks - 1)
+        {
+            curMin = min(curMin, blockMin[b]);
+            curMax = max(curMax, blockMax[b]);
+        }
+        blockMin[b] = lo;
+        blockMax[b] = hi;
+    }
+
+    // rescan every block from its carry-in, and compact its rejections and expansions
+    parallelBlocks(pool, n, nBlocks, [&](int b, int first, int last)
+    {
+        Score lo = blockMin[b], hi = blockMax[b];
+        int *out = nBlocks == 1 ? events : scratch + first;
+        int count = 0;
+        for (int i = begin + first; i < begin + last; i++)
+        {
+            minScan[i] = lo;
+            maxScan[i] = hi;
+
+            if (ignored[i])
+                continue;
+
+            Score val = currentNodeVals[i];
+            if (expectedMore[i] == false)
+            {
+                if (val <= lo)
+                    out[count++] = i << 1;
+                if (val > hi)
+                {
+                    out[count++] = (i << 1) | FRONTIER_EVENT_EXPAND;
+                    hi = val;
+                }
+            }
+            else
+            {
+                if (val >= hi)
+                    out[count++] = i << 1;
+                if (val < lo)
+                {
+                    out[count++] = (i << 1) | FRONTIER_EVENT_EXPAND;
+                    lo = val;
+                }
+            }
+        }
+        blockEvents[b] = count;
+    });
+
+    if (nBlocks == 1)
+        return blockEvents[0];
+
+    int offset[MAX_THREADS];
+    int nEvents = 0;
+    for (int b = 0; b < nBlocks; b++)
+    {
+        offset[b] = nEvents;
+        nEvents += blockEvents[b];
+    }
+
+    parallelBlocks(pool, n, nBlocks, [&](int b, int first, int)
+    {
+        memcpy(events + offset[b], scratch + first, blockEvents[b] * sizeof(int));
+    });
+
+    return nEvents;
+}
+
+// Speculative parallel expansion for exploreTree's main loop
+//
+// Each pass of the loop expands candidates one at a time and every expansion runs a full exploreSubTree()
+// on the next unexplored sibling of a CUT node. Before a pass we predict which siblings it is going to
+// explore, and with what cut value, by running the accept/reject scan without side effects, and explore
+// those subtrees in parallel. The siblings are unexplored, so their subtrees are disjoint from each other
+// and from everything else the pass touches.
+// The pass itself then runs serially as before. When expandNode() gets to a sibling that was explored
+// speculatively with the same cut value it takes the result, otherwise the subtree is reset and explored
+// again. So the tree ends up exactly as in a serial run, whatever the number of threads.
+
+struct SpeculativeTask
+{
+    Node *sibling;
+    Score cutVal;
+    Score result;
+    unsigned char nodeType;     // sibling's nodeType after exploreSubTree()
+    int   subTreeCount;         // exploreSubTree() calls it made
+    bool  consumed;
+};
+
+struct ExpansionSpeculation
+{
+    SpeculativeTask *tasks;
+    int nTasks;
+    int *hash;                  // sibling -> task index (open addressing, -1 if empty)
+    int hashSize;
+    std::atomic<int> nextTask;
+};
+
+int gSpeculativeTasks = 0;
+int gSpeculativeHits = 0;
+
+static inline int hashNode(Node *node, int hashSize)
+{
+    return (int) ((((size_t) node / sizeof(Node)) * 2654435761u) & (hashSize - 1));
+}
+
+SpeculativeTask *findSpeculativeTask(ExpansionSpeculation *spec, Node *sibling)
+{
+    for (int h = hashNode(sibling, spec->hashSize); spec->hash[h] != -1; h = (h + 1) & (spec->hashSize - 1))
+    {
+        if (spec->tasks[spec->hash[h]].sibling == sibling)
+            return &spec->tasks[spec->hash[h]];
+    }
+    return NULL;
+}
+
+// read only version of expandNode()'s walk up: the sibling it would explore for this frontier node
+// (assuming the ALL node checks on the way pass), NULL if it wouldn't explore anything
+Node *predictExpansion(Node *thisNode)
+{
+    Node *currentParent = thisNode->parent;
+    if (!currentParent)
+        return NULL;
+
+    while (nodeState(currentParent)->nChildsExplored == currentParent->nChildren)
+    {
+        currentParent = currentParent->parent;
+        if (!currentParent || nodeState(currentParent)->nodeType == PV_NODE)
+            return NULL;
+    }
+
+    return &currentParent->children[nodeState(currentParent)->nChildsExplored];
+}
+
+// undo a speculative exploreSubTree() whose result wasn't used
+void resetSubTree(Node *node)
+{
+    nodeState(node)->frontierOffset = -1;
+    nodeState(node)->numChildrenAtFrontier = 0;
+    if (node->children)
+    {
+        int n = min(nodeState(node)->nChildsExplored, node->nChildren);
+        for (int i = 0; i < n; i++)
+            resetSubTree(&node->children[i]);
+    }
+    nodeState(node)->nChildsExplored = 0;
+}
+
+void runSpeculativeTasks(ExpansionSpeculation *spec)
+{
+    int t;
+    while ((t = spec->nextTask++) < spec->nTasks)
+    {
+        TRACE_SCOPE("speculative task");
+        SpeculativeTask *task = &spec->tasks[t];
+        int count = exploreSubTreeCount;
+
+        // same as expandNode() does before exploring a sibling
+        nodeState(task->sibling)->nodeType = ALL_NODE;
+        task->result = exploreSubTree(task->sibling, task->cutVal);
+
+        // only counted if the result gets used
+        task->nodeType = nodeState(task->sibling)->nodeType;
+        task->subTreeCount = exploreSubTreeCount - count;
+        exploreSubTreeCount = count;
+    }
+}
+
+// runs the acceptance scan of exploreTree's main loop and explores the predicted siblings in parallel, on the
+// threads of the pool
+ExpansionSpeculation *speculateExpansions(Node **fullCurrentFrontier, Score *currentNodeVals, bool *expectedMore, bool *ignored,
+                                          int nCurr, Score curMin, Score curMax, Score *minScan, Score *maxScan,
+                                          int *events, int *scratch, WorkerPool *pool)
+{
+    TRACE_SCOPE("speculateExpansions");
+    ExpansionSpeculation *spec = new ExpansionSpeculation();
+    spec->tasks = (SpeculativeTask *) malloc(nCurr * sizeof(SpeculativeTask));
+    spec->hashSize = 16;
+    while (spec->hashSize < 2 * nCurr)
+        spec->hashSize *= 2;
+    spec->hash = (int *) malloc(spec->hashSize * sizeof(int));
+    memset(spec->hash, -1, spec->hashSize * sizeof(int));
+    spec->nTasks = 0;
+    spec->nextTask = 0;
+
+    int nEvents = scanFrontier(currentNodeVals, expectedMore, ignored, 1, nCurr, curMin, curMax, minScan, maxScan,
+                               events, scratch, pool);
+    for (int e = 0; e < nEvents; e++)
+    {
+        if (!(events[e] & FRONTIER_EVENT_EXPAND))
+            continue;
+
+        int i = events[e] >> 1;
+        Score curBest = currentNodeVals[i];
+
+        Node *sibling = predictExpansion(fullCurrentFrontier[i]);
+
+        // the first candidate that gets to a sibling explores it
+        if (!sibling || findSpeculativeTask(spec, sibling))
+            continue;
+
+        SpeculativeTask *task = &spec->tasks[spec->nTasks];
+        task->sibling = sibling;
+        task->cutVal = curBest;
+        task->consumed = false;
+
+        int h = hashNode(sibling, spec->hashSize);
+        while (spec->hash[h] != -1)
+            h = (h + 1) & (spec->hashSize - 1);
+        spec->hash[h] = spec->nTasks++;
+    }
+
+    gSpeculativeTasks += spec->nTasks;
+
+    // the threads of the pool take tasks until there are none left
+    runOnPool(pool, min(pool->nThreads, spec->nTasks), [=](int) { runSpeculativeTasks(spec); });
+
+    return spec;
+}
+
+// explore the sibling, or take the speculative result if there is one for the same cut value
+Score exploreSiblingSubTree(ExpansionSpeculation *spec, Node *sibling, Score curBest)
+{
+    SpeculativeTask *task = spec ? findSpeculativeTask(spec, sibling) : NULL;
+    if (task && !task->consumed)
+    {
+        task->consumed = true;
+        if (task->cutVal == curBest)
+        {
+            gSpeculativeHits++;
+            exploreSubTreeCount += task->subTreeCount;
+            nodeState(sibling)->nodeType = task->nodeType;
+            return task->result;
+        }
+
+        resetSubTree(sibling);
+    }
+
+    return exploreSubTree(sibling, curBest);
+}
+
+// reset the subtrees the pass didn't use so that they look unexplored again
+void endSpeculation(ExpansionSpeculation *spec)
+{
+    TRACE_SCOPE("endSpeculation");
+    for (int t = 0; t < spec->nTasks; t++)
+    {
+        if (!spec->tasks[t].consumed)
+            resetSubTree(spec->tasks[t].sibling);
+    }
+
+    free(spec->tasks);
+    free(spec->hash);
+    delete spec;
+}
+
+// Out-of-core frontier
+//
+// exploreTree() keeps the frontier for the final level and a few arrays per entry (values, scan bounds, flags),
+// for deep trees the biggest allocations after the tree itself. Arrays larger than gFrontierSpillBytes are put
+// in temporary files which are mapped instead of allocated on the heap, so the system pages them in and out and
+// their size is limited by the disk rather than by RAM. The levels are built and reduced in chunks of
+// FRONTIER_CHUNK entries in order, and once a chunk is done its pages are written out and dropped from the
+// working set, so building a level needs memory for about one chunk per array. The expansion loop scans the
+// frontier in order as well, the pages it needs are left to the system.
+
+#define FRONTIER_CHUNK       (1 << 20)      // entries
+#define FRONTIER_PAGE_SIZE   4096
+#define FRONTIER_HEADER_SIZE 64             // keeps the entries aligned
+
+size_t gFrontierSpillBytes = 256 * 1024 * 1024;    // 0: every frontier array goes to a file
+const char *gFrontierSpillDir = NULL;               // the temp directory if NULL
+size_t gFrontierSpilledBytes = 0;                   // by the last exploreTree()
+
+// sits in front of every frontier array
+struct FrontierArrayHeader
+{
+    HANDLE file;        // NULL for arrays on the heap
+    HANDLE mapping;
+    size_t size;
+};
+
+void *frontierAlloc(size_t size)
+{
+    FrontierArrayHeader header = { NULL, NULL, size };
+    char *mem = NULL;
+
+    if (size >= gFrontierSpillBytes)
+    {
+        char dir[MAX_PATH], path[MAX_PATH];
+        if (gFrontierSpillDir)
+            snprintf(dir, MAX_PATH, "%s", gFrontierSpillDir);
+        else
+            GetTempPathA(MAX_PATH, dir);
+
+        HANDLE file = INVALID_HANDLE_VALUE;
+        if (GetTempFileNameA(dir, "frn", 0, path))
+            file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                               FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+        if (file != INVALID_HANDLE_VALUE)
+        {
+            unsigned long long fileSize = size + FRONTIER_HEADER_SIZE;
+            header.mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD) (fileSize >> 32), (DWORD) fileSize, NULL);
+            if (header.mapping)
+                mem = (char *) MapViewOfFile(header.mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+
+            if (mem)
+            {
+                header.file = file;
+                gFrontierSpilledBytes += size;
+            }
+            else
+            {
+                if (header.mapping)
+                    CloseHandle(header.mapping);
+                CloseHandle(file);
+                header.mapping = NULL;
+            }
+        }
+    }
+
+    // not spilled, or no file could be had
+    if (!mem)
+        mem = (char *) malloc(size + FRONTIER_HEADER_SIZE);
+
+    memcpy(mem, &header, sizeof(header));
+    return mem + FRONTIER_HEADER_SIZE;
+}
+
+void frontierFree(void *array)
+{
+    char *mem = (char *) array - FRONTIER_HEADER_SIZE;
+    FrontierArrayHeader *header = (FrontierArrayHeader *) mem;
+    if (header->file)
+    {
+        HANDLE file = header->file, mapping = header->mapping;
+        UnmapViewOfFile(mem);
+        CloseHandle(mapping);
+        CloseHandle(file);      // deletes it
+    }
+    else
+    {
+        free(mem);
+    }
+}
+
+// done with entries [begin, end) of a frontier array for now: a spilled array writes the pages they cover
+// out and drops them from the working set (unlocking pages that aren't locked does that)
+void frontierRelease(void *array, size_t entrySize, int begin, int end)
+{
+    char *mem = (char *) array - FRONTIER_HEADER_SIZE;
+    if (!((FrontierArrayHeader *) mem)->file)
+        return;
+
+    size_t first = (FRONTIER_HEADER_SIZE + begin * entrySize + FRONTIER_PAGE_SIZE - 1) / FRONTIER_PAGE_SIZE;
+    size_t last = (FRONTIER_HEADER_SIZE + end * entrySize) / FRONTIER_PAGE_SIZE;
+    if (last <= first)
+        return;
+
+    FlushViewOfFile(mem + first * FRONTIER_PAGE_SIZE, (last - first) * FRONTIER_PAGE_SIZE);
+    VirtualUnlock(mem + first * FRONTIER_PAGE_SIZE, (last - first) * FRONTIER_PAGE_SIZE);
+}
+
+// a non-recursive and hopefully somewhat parallel algorithm based on alpha beta, nThreads is for the
+// speculative expansions and the frontier scans. The node is searched as the root (a node with no parent)
+Score exploreTree(Node *node, int depth, int nThreads)
+{
+    TRACE_SCOPE("exploreTree");
+    exploreSubTreeCount = 0;
+    gSpeculativeTasks = gSpeculativeHits = 0;
+    gFrontierSpilledBytes = 0;
+
+    // for the whole search, see WorkerPool
+    WorkerPool *pool = createWorkerPool(nThreads);
+
+    // the frontier / current list of nodes that need to be explored / nodes at the current level
+    // TODO: many of these lists are probably redundant - get rid of some later
+    Node *currentPVNode   = NULL;       Node *nextPVNode   = NULL;
+    Node *currentCutNodes = NULL;       Node *nextCutNodes = NULL;
+    Node *currentAllNodes = NULL;       Node *nextAllNodes = NULL;
+    int nCutNodes = 0, nAllNodes = 0;
+    int nNextCutNodes = 0, nNextAllNodes = 0;
+
+    // full frontier
+    Node **fullCurrentFrontier = NULL;
+    Node **fullNextFrontier    = NULL;
+    int nCurr, nNext;
+
+    // 1. PV based initial tree generation
+    TRACE_BEGIN("frontier build");
+    nodeState(node)->nodeType = PV_NODE;   // the root is always a PV node
+    currentPVNode = node;
+    fullCurrentFrontier = (Node **) frontierAlloc(sizeof(Node *));
+    fullCurrentFrontier[0] = node;
+    nCurr = 1;
+
+    bool isMaxLevel = node->isMaxNode;
+    for (int i = 0; i < depth - 1; i++)
+    {
+        // explore the frontier nodes
+
+        // figure out total no. of childs that need to be explored for all frontier nodes
+        nNext = 0;
+        for (int j=0; j<nCurr; j++)
+        {
+            int childsToExplore = 0;
+            switch (nodeState(fullCurrentFrontier[j])->nodeType)
+            {
+                case PV_NODE:
+                case ALL_NODE:
+                    childsToExplore = fullCurrentFrontier[j]->nChildren;
+                    break;
+                case CUT_NODE:
+                    childsToExplore = 1;
+                    break;
+            }
+
+            nNext += childsToExplore;
+        }
+        
+        if (gBudget)
+            budgetTick(nNext);
+
+        // allocate memory for the next frontier
+        fullNextFrontier = (Node **) frontierAlloc(nNext * sizeof(Node *));
+        
+        int index = 0, released = 0;
+        // fill in the next frontier
+        for (int j=0; j<nCurr; j++)
+        {
+            switch (nodeState(fullCurrentFrontier[j])->nodeType)
+            {
+                case PV_NODE:
+                    for (int k = 0; k < fullCurrentFrontier[j]->nChildren; k++)
+                    {
+                        Node *curNode = &(fullCurrentFrontier[j]->children[k]);
+                        if (index == 0) // first child of PV node is PV node
+                            nodeState(curNode)->nodeType = PV_NODE;
+                        else            // others are CUT nodes
+                            nodeState(curNode)->nodeType = CUT_NODE;
+                        fullNextFrontier[index++] = curNode;
+                    }
+                    nodeState(fullCurrentFrontier[j])->nChildsExplored = fullCurrentFrontier[j]->nChildren;
+
+                    break;
+                case ALL_NODE:
+                    for (int k = 0; k < fullCurrentFrontier[j]->nChildren; k++)
+                    {
+                        Node *curNode = &(fullCurrentFrontier[j]->children[k]);
+                        nodeState(curNode)->nodeType = CUT_NODE;   // child of ALL node is cut node
+                        fullNextFrontier[index++] = curNode;
+                    }
+                    nodeState(fullCurrentFrontier[j])->nChildsExplored = fullCurrentFrontier[j]->nChildren;
+                    break;
+                case CUT_NODE:
+                    {
+                        nodeState(fullCurrentFrontier[j])->nChildsExplored = 1;
+                        nodeState(&fullCurrentFrontier[j]->children[0])->nodeType = ALL_NODE;
+                        fullNextFrontier[index++] = &(fullCurrentFrontier[j]->children[0]);
+                    }
+            }
+
+            // Ankan - not known yet, but initialize with first child
+            nodeState(fullCurrentFrontier[j])->best = &(fullCurrentFrontier[j]->children[0]);
+            nodeState(fullCurrentFrontier[j])->bestChild = 0;
+
+            // end of a chunk, see frontierRelease()
+            if ((j + 1) % FRONTIER_CHUNK == 0 || j + 1 == nCurr)
+            {
+                frontierRelease(fullCurrentFrontier, sizeof(Node *), j / FRONTIER_CHUNK * FRONTIER_CHUNK, j + 1);
+                frontierRelease(fullNextFrontier, sizeof(Node *), released, index);
+                released = index;
+            }
+        }
+
+        assert(index == nNext);
+
+        // go to next depth, set current = next
+        frontierFree(fullCurrentFrontier);
+
+        nCurr = nNext;
+        fullCurrentFrontier = fullNextFrontier;
+
+        isMaxLevel = !isMaxLevel;
+    }
+    
+
+    TRACE_END("frontier build");
+
+    // when generating the last level evaluate all ALL nodes at the level just above the CUT node leaves
+    TRACE_BEGIN("final level reduction");
+    // for depth 5 search, we need to do a MAX reduction (see modern gpu's segmented reduction example when implementing parallel version)
+
+    fullNextFrontier = (Node **) frontierAlloc(nCurr * sizeof(Node *));
+    bool *expectedMore = (bool *) frontierAlloc(nCurr * sizeof(bool));
+    Score *currentNodeVals = (Score *) frontierAlloc(nCurr * sizeof(Score));
+
+    for (int i=0;i<nCurr;i++)
+    {
+        Node *curNode = fullCurrentFrontier[i];
+        nodeState(curNode)->nodeVal = isMaxLevel ? -INF : INF;
+        if(nodeState(curNode)->nodeType == PV_NODE || nodeState(curNode)->nodeType == ALL_NODE)
+        {
+            reduceChildren(curNode, isMaxLevel);
+            fullNextFrontier[i] = curNode;
+            currentNodeVals[i] = nodeState(curNode)->nodeVal;
+            nodeState(curNode)->nChildsExplored = curNode->nChildren;
+            expectedMore[i] = isMaxLevel ? false : true;
+        }
+        else
+        {
+            nodeState(curNode)->best = &curNode->children[0];
+            nodeState(curNode)->bestChild = 0;
+
+            nodeState(curNode)->nChildsExplored = 1;
+            nodeState(&curNode->children[0])->nodeType = ALL_NODE;
+            fullNextFrontier[i] = &curNode->children[0];
+            currentNodeVals[i] = evaluateLeaf(fullNextFrontier[i]);
+            expectedMore[i] = isMaxLevel ? true : false;
+        }
+
+        nodeState(fullNextFrontier[i])->numChildrenAtFrontier = 1;
+        nodeState(fullNextFrontier[i])->frontierOffset = i;
+
+        if ((i + 1) % FRONTIER_CHUNK == 0 || i + 1 == nCurr)
+        {
+            int chunk = i / FRONTIER_CHUNK * FRONTIER_CHUNK;
+            frontierRelease(fullCurrentFrontier, sizeof(Node *), chunk, i + 1);
+            frontierRelease(fullNextFrontier, sizeof(Node *), chunk, i + 1);
+            frontierRelease(expectedMore, sizeof(bool), chunk, i + 1);
+            frontierRelease(currentNodeVals, sizeof(Score), chunk, i + 1);
+        }
+    }
+
+    frontierFree(fullCurrentFrontier);
+    fullCurrentFrontier = fullNextFrontier;
+
+    // the PV nodes above start out with the value of the first entry, expandNode() updates them from there
+    for (Node *pvNode = fullCurrentFrontier[0]->parent; pvNode; pvNode = pvNode->parent)
+        nodeState(pvNode)->nodeVal = currentNodeVals[0];
+
+
+    Score *minScan = (Score *) frontierAlloc(sizeof(Score) * nCurr);
+    Score *maxScan = (Score *) frontierAlloc(sizeof(Score) * nCurr);
+    bool *ignored = (bool *) frontierAlloc(sizeof(bool) * nCurr);
+    memset(ignored, 0, sizeof(bool) * nCurr);
+    int *events = (int *) frontierAlloc(sizeof(int) * nCurr);
+    int *scanScratch = (int *) frontierAlloc(sizeof(int) * nCurr);
+
+    Score curMin, curMax;
+    curMin = curMax = currentNodeVals[0];  // init. with value of PV node
+
+    int nRejected = 0;
+    int nExpnded = 0;
+
+    TRACE_END("final level reduction");
+
+    // propogate frontier offsets from leafs up the tree
+    TRACE_BEGIN("propogateFrontierOffsets");
+    int count;
+    int start = propogateFrontierOffsets(node, &count);
+    assert(start == 0 && count == nCurr);
+    TRACE_END("propogateFrontierOffsets");
+
+    int iterations = 0;
+
+    TRACE_BEGIN("expansion loop");
+    do
+    {
+        TRACE_SCOPE("iteration");
+        iterations++;
+
+        nRejected = 0;
+        nExpnded = 0;
+
+        // ignore all nodes to the left of bestNow
+        for (int i = 0; i < nCurr; i++)
+        {
+            ignored[i] = true;
+
+            // Unnecessary and expensive. TODO: figure out better way
+            bool found = false;
+            Node *bestNow = node;
+            while (bestNow->children)
+            {
+                bestNow = nodeState(bestNow)->best;
+                if (bestNow == fullCurrentFrontier[i])
+                {
+                    found = true;
+                }
+            }
+
+            if (found)
+            {
+                curMin = curMax = bestNow->nodeVal;
+                break;
+            }
+        }
+
+        // explore the subtrees this pass is likely to need in parallel
+        ExpansionSpeculation *spec = NULL;
+        if (nThreads > 1)
+            spec = speculateExpansions(fullCurrentFrontier, currentNodeVals, expectedMore, ignored, nCurr, curMin, curMax,
+                                       minScan, maxScan, events, scanScratch, pool);
+
+        // the entries to reject or expand, see scanFrontier()
+        int nEvents = scanFrontier(currentNodeVals, expectedMore, ignored, 1, nCurr, curMin, curMax, minScan, maxScan,
+                                   events, scanScratch, pool);
+        int ticked = 1;
+        for (int e = 0; e < nEvents; e++)
+        {
+            int i = events[e] >> 1;
+            if (gBudget && budgetTick(i + 1 - ticked))
+                break;
+            ticked = i + 1;
+
+            // all nodes that are explored here must be ALL nodes
+            assert(nodeState(fullCurrentFrontier[i])->nodeType = ALL_NODE ||
+                   nodeState(fullCurrentFrontier[i])->nChildsExplored == fullCurrentFrontier[i]->nChildren);
+
+            if (!(events[e] & FRONTIER_EVENT_EXPAND))
+            {
+                // reject this branch (i.e, no need to evaluate any more siblings)
+                nRejected++;
+                ignored[i] = true;
+                continue;
+            }
+
+            // need to evaluate more siblings of this node, its value is the new bound
+            Score curBest = currentNodeVals[i];
+            int lastIgnored = i;
+            expandNode(fullCurrentFrontier, currentNodeVals, i, curBest, NULL, ignored, spec, &lastIgnored);
+            nExpnded++;
+
+            // entries further ahead were ignored by the expansion, the rest of the events are stale
+            if (lastIgnored > i)
+            {
+                curMin = expectedMore[i] ? curBest : minScan[i];
+                curMax = expectedMore[i] ? maxScan[i] : curBest;
+                nEvents = scanFrontier(currentNodeVals, expectedMore, ignored, i + 1, nCurr, curMin, curMax, minScan,
+                                       maxScan, events, scanScratch, pool);
+                e = -1;
+            }
+        }
+        if (gBudget && !gSearchStopped)
+            budgetTick(nCurr - ticked);
+
+        if (spec)
+            endSpeculation(spec);
+
+    } while (nExpnded && !gSearchStopped);
+    TRACE_END("expansion loop");
+
+    printf("\nFrontier Nodes: %d, main loop iterations: %d, explore subtree count: %d", nCurr, iterations, exploreSubTreeCount);
+    if (gSpeculativeTasks)
+        printf("\nspeculative expansions: %d, used: %d", gSpeculativeTasks, gSpeculativeHits);
+    if (gFrontierSpilledBytes)
+        printf("\nfrontier spilled to disk: %g MB", gFrontierSpilledBytes / (1024.0 * 1024.0));
+    printf("\nExplore Tree found value: %f\n", scoreToFloat(nodeState(node)->nodeVal));
+
+
+
+    frontierFree(events);
+    frontierFree(scanScratch);
+    frontierFree(minScan);
+    frontierFree(maxScan);
+    frontierFree(ignored);
+    frontierFree(expectedMore);
+    frontierFree(currentNodeVals);
+    frontierFree(fullCurrentFrontier);
+    destroyWorkerPool(pool);
+    return nodeState(node)->nodeVal;
+}
+
+// exploreTree() under the current budget with the root children searched one by one, as in
+// alphabetaRootChildren(): if the budget runs out the child being searched is discarded and the value of the
+// best completed one is a lower bound. Each child is searched as the root of its own tree, its parent link is
+// cut meanwhile
+Score exploreTreeRootChildren(Node *node, int depth, int nThreads, int *bestChild)
+{
+    Score alpha = -INF;
+    *bestChild = 0;
+    for (int i = 0; i < node->nChildren; i++)
+    {
+        Node *child = &node->children[i];
+        child->parent = NULL;
+        Score curScore = depth > 1 ? exploreTree(child, depth - 1, nThreads) : evaluateLeaf(child);
+        child->parent = node;
+        if (gSearchStopped)
+            break;
+
+        if (curScore > alpha)
+        {
+            alpha = curScore;
+            *bestChild = i;
+        }
+    }
+    return alpha;
+}
+
+// anytime exploreTree, see exploreTreeRootChildren()
+SearchResult exploreTreeAnytime(Node *node, int depth, const SearchBudget *budget)
+{
+    SearchResult result;
+    START_TIMER
+    startBudget(budget);
+    budgetThreadStart();
+
+    int bestChild;
+    Score alpha = exploreTreeRootChildren(node, depth, g_numThreads, &bestChild);
+
+    result.nodes = gBudgetNodes + gBudgetPending;
+    result.completed = !endBudget();
+    result.value = alpha;
+    result.bestChild = bestChild;
+    if (result.completed)
+    {
+        nodeState(node)->nodeVal = alpha;
+        nodeState(node)->best = &node->children[bestChild];
+        nodeState(node)->bestChild = bestChild;
+    }
+    STOP_TIMER
+    result.time = gTime;
+
+    return result;
+}
+
+// Minimal tree analysis
+//
+// How much more than necessary an engine searches, independent of how fast it does it. The minimal (critical)
+// tree of Knuth and Moore is what alpha-beta searches with perfect move ordering: all children of PV nodes,
+// the best child of CUT nodes (the refutation) and all children of ALL nodes, the best child of a PV node being
+// a PV node and the others CUT nodes. The best children come from negaMax(). Any search has to visit at least
+// about as many nodes to prove the root value.
+// The nodes an engine visited are read off its search state afterwards: alphabeta() and exploreTree() explore
+// children in order and record how many in nChildsExplored. SSS* clears nChildsExplored when purging, so it counts its
+// expansions in gVisitCounts instead. Visited nodes are classified by their expected type, the way
+// exploreTree() assigns nodeType: the first child of a PV node is PV and the others CUT, the children of CUT
+// nodes are ALL and the children of ALL nodes CUT.
+
+// nodes per ply and per node type (PV_NODE, CUT_NODE, ALL_NODE)
+struct TreeCounts
+{
+    int count[MAX_DEPTH + 1][4];
+    int total;
+};
+
+// the nodes SSS_star() expands are counted here when not NULL
+TreeCounts *gVisitCounts = NULL;
+
+inline int childNodeType(int type, bool firstChild)
+{
+    if (type == PV_NODE)
+        return firstChild ? PV_NODE : CUT_NODE;
+    return type == CUT_NODE ? ALL_NODE : CUT_NODE;
+}
+
+int expectedNodeType(Node *node)
+{
+    if (!node->parent)
+        return PV_NODE;
+    return childNodeType(expectedNodeType(node->parent), node == &node->parent->children[0]);
+}
+
+void countVisit(Node *node, int ply)
+{
+    gVisitCounts->count[ply][expectedNodeType(node)]++;
+    gVisitCounts->total++;
+}
+
+struct ListItem
+{
+    Node *node;
+    Score merit;    // upper bound for live, actual value for solved
+    int   depth;    // depth of the node (used to identify leaf/root)
+    bool  live;     // true - live, false - solved
+};
+
+#define MAX_LIST_SIZE 100000
+
+
+int g_sssNodes = 0;
+class List
+{
+private:
+    // simple array based implementation. O(n) complexity for most operations
+    ListItem m_list[MAX_LIST_SIZE];
+    int n;
+
+public:
+    List()
+    {
+        n = 0;
+        memset(m_list, 0, sizeof(m_list));
+    };
+
+    void addItem(Node *node, bool live, Score merit, int depth)
+    {
+        ListItem newItem;
+        newItem.live = live;
+        newItem.node = node;
+        newItem.merit = merit;
+        newItem.depth = depth;
+        m_list[n++] = newItem;
+
+        // the node is not expanded yet, don't let purgeSubTree() follow counts other searches left in the state
+        if (live == true)
+        {
+            nodeState(node)->nChildsExplored = 0;
+            g_sssNodes++;
+        }
+    };
+
+
+    // return index of max node in the list
+    int findMax()
+    {
+        int maxIndex = 0;
+        ListItem max = m_list[0];
+        for (int i=1; i<n; i++)
+        {
+            if (m_list[i].merit > max.merit)
+            {
+                max = m_list[i];
+                maxIndex = i;
+            }
+        }
+        
+        return maxIndex;
+    }
+
+    ListItem getMax()
+    {
+        return m_list[findMax()];
+    };
+
+    // return index of node in the list
+    int findItem(Node *node)
+    {
+        for (int i=0; i<n; i++)
+            if (m_list[i].node == node)
+                return i;
+
+        // NOT FOUND
+        return -1;
+    }
+    
+    void deleteIndex(int index)
+    {
+        if (index >= 0)
+        {
+            for (int i=index; i < n-1; i++)
+                m_list[i] = m_list[i+1];
+            n--;
+        }
+    }
+
+    void deleteItem(Node *node)
+    {
+        deleteIndex(findItem(node));
+    }
+
+    ListItem extractMax()
+    {
+        int maxIndex = findMax();
+        ListItem max = m_list[maxIndex];
+        deleteIndex(maxIndex);
+        return max;
+    }
+
+};
+
+void purgeSubTree(List *list, Node *node)
+{
+    if (nodeState(node)->nChildsExplored)
+    {
+        for (int i=0; i<nodeState(node)->nChildsExplored; i++)
+        {
+            purgeSubTree(list, &node->children[i]);
+        }
+    }
+
+    nodeState(node)->nChildsExplored = 0;
+
+    list->deleteItem(node);
+}
+
+Score SSS_star(Node *node, int depth)
+{
+    TRACE_SCOPE("SSS*");
+    List *activeNodes = new List();
+
+    nodeState(node)->nChildsExplored = 0;
+    activeNodes->addItem(node, true, INF, 0);
+    
+    while(true)
+    {
+        // OPEN list operations are O(n), check the budget more often
+        if (gBudget && budgetTick(1, 64))
+        {
+            // out of budget: the best merit in OPEN is an upper bound on the root value,
+            // report the root child it came from as the best move
+            ListItem top = activeNodes->getMax();
+            Node *move = top.node;
+            while (move != node && move->parent != node)
+                move = move->parent;
+            if (move != node)
+                nodeState(node)->bestChild = (ChildIndex) (move - node->children);
+
+            delete activeNodes;
+            return top.merit;
+        }
+
+        ListItem node = activeNodes->extractMax();
+        if (node.live)
+        {
+            if (gVisitCounts)
+                countVisit(node.node, node.depth);
+
+            if (node.depth == depth)    // leaf
+            {
+                activeNodes->addItem(node.node, false, min(node.merit, evaluateLeaf(node.node)), node.depth);                
+            }
+            else if (node.depth % 2 == 1)   // min node
+            {
+                activeNodes->addItem(&node.node->children[0], true, node.merit, node.depth + 1);
+
+                nodeState(node.node)->nChildsExplored = 1;
+            }
+            else    // max node
+            {
+                for (int j=0; j<node.node->nChildren; j++)
+                    activeNodes->addItem(&node.node->children[j], true, node.merit, node.depth + 1);
+
+                nodeState(node.node)->nChildsExplored = node.node->nChildren;
+            }
+        }
+        else    // solved
+        {
+            if (node.depth == 0)
+            {
+                delete activeNodes;
+                return node.merit;
+            }
+            else if (node.depth % 2 == 1)   // min node
+            {
+                // purge parent and it's all children present in the list
+                // TODO: optimize this
+                purgeSubTree(activeNodes, node.node->parent);
+                activeNodes->addItem(node.node->parent, false, node.merit, node.depth - 1);
+
+                if (node.depth == 1)
+                {
+                    // find the child node index for best move
+                    for (int  i=0; i<node.node->parent->nChildren; i++)
+                    {
+                        if (node.node == &node.node->parent->children[i])
+                        {
+                            nodeState(node.node->parent)->bestChild = i;
+                            break;
+                        }
+                    }
+                }
+            }
+            else    // max node
+            {
+                if (nodeState(node.node->parent)->nChildsExplored != node.node->parent->nChildren)
+                {   // if node has unexplored brother, explore it
+                    activeNodes->addItem(&node.node->parent->children[nodeState(node.node->parent)->nChildsExplored++], true, node.merit, node.depth);
+                }
+                else
+                {
+                    activeNodes->addItem(node.node->parent, false, node.merit, node.depth - 1);
+                }
+            }
+        }
+    }
+
+    delete activeNodes;
+    return 0;
+}
+
+// anytime SSS*: if stopped, the value is an upper bound on the root value
+SearchResult SSS_starAnytime(Node *node, int depth, const SearchBudget *budget)
+{
+    SearchResult result;
+    START_TIMER
+    startBudget(budget);
+    budgetThreadStart();
+    g_sssNodes = 0;
+    result.value = SSS_star(node, depth);
+    result.completed = !endBudget();
+    result.bestChild = nodeState(node)->bestChild;
+    result.nodes = g_sssNodes;
+    STOP_TIMER
+    result.time = gTime;
+
+    return result;
+}
+
+
+// Parallel SSS*
+//
+// The OPEN list is replaced by a relaxed concurrent priority queue (MultiQueue): a few binary heaps
+// per thread, each with its own lock. A worker pops from the better of two randomly picked shards,
+// so pops are only approximately in merit order.
+//
+// Out of order processing is harmless for all SSS* operators except the one that solves a MAX node
+// from a solved child (the one that purges the subtree). That one is only valid if the merit of the
+// solved child is >= the merit of everything else still in OPEN, so before applying it a worker
+// checks the item against the published shard tops and the items other workers are processing.
+// If the check fails the item goes back to the queue.
+//
+// Purge is lazy: the solved MAX node is marked closed and items whose ancestors are closed are thrown
+// away when they are popped. The closed marks are atomic flags of their own (one per node id), not part
+// of NodeState, so workers read them without locks while others are updating the node counters.
+
+#define PSSS_SHARDS_PER_THREAD 2
+#define PSSS_MAX_SHARDS (MAX_THREADS * PSSS_SHARDS_PER_THREAD)
+
+int g_psssNodes = 0;
+
+class PQShard
+{
+private:
+    // binary max-heap on merit
+    ListItem *m_heap;
+    int n;
+    int m_size;
+
+public:
+    std::mutex lock;
+    std::atomic<Score> top;     // merit of the top item, -INF if empty. Read without holding the lock
+
+    PQShard()
+    {
+        n = 0;
+        m_size = 1024;
+        m_heap = (ListItem *) malloc(m_size * sizeof(ListItem));
+        top = -INF;
+    }
+
+    ~PQShard()
+    {
+        free(m_heap);
+    }
+
+    // caller holds the lock
+    void push(const ListItem &item)
+    {
+        if (n == m_size)
+        {
+            m_size *= 2;
+            m_heap = (ListItem *) realloc(m_heap, m_size * sizeof(ListItem));
+        }
+
+        int i = n++;
+        while (i > 0 && m_heap[(i - 1) / 2].merit < item.merit)
+        {
+            m_heap[i] = m_heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        m_heap[i] = item;
+
+        top = m_heap[0].merit;
+    }
+
+    // caller holds the lock, the shard must not be empty
+    ListItem pop()
+    {
+        ListItem max = m_heap[0];
+        ListItem last = m_heap[--n];
+
+        int i = 0;
+        while (2 * i + 1 < n)
+        {
+            int c = 2 * i + 1;
+            if (c + 1 < n && m_heap[c + 1].merit > m_heap[c].merit)
+                c++;
+            if (m_heap[c].merit <= last.merit)
+                break;
+            m_heap[i] = m_heap[c];
+            i = c;
+        }
+        if (n)
+            m_heap[i] = last;
+
+        top = n ? m_heap[0].merit : -INF;
+        return max;
+    }
+
+    bool empty()
+    {
+        return n == 0;
+    }
+
+    // direct access to the items (in heap order), only when no one else is using the shard
+    int size()
+    {
+        return n;
+    }
+
+    ListItem *item(int i)
+    {
+        return &m_heap[i];
+    }
+};
+
+struct ParallelSSSState
+{
+    PQShard shards[PSSS_MAX_SHARDS];
+    int nShards;
+    int nThreads;
+
+    // per worker: merit of the item being processed, valid while seq is odd
+    std::atomic<Score>    inflight[MAX_THREADS];
+    std::atomic<unsigned> seq[MAX_THREADS];
+    int nodes[MAX_THREADS];
+
+    std::atomic<unsigned char> *closed;     // per node id, set once the MAX node is solved
+
+    Node *root;
+    int depth;
+    std::atomic<bool> done;
+    Score result;
+};
+
+static inline unsigned psssRand(unsigned *state)
+{
+    // xorshift32
+    unsigned x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+void psssPush(ParallelSSSState *state, int id, unsigned *rng, Node *node, bool live, Score merit, int depth)
+{
+    ListItem item;
+    item.node = node;
+    item.live = live;
+    item.merit = merit;
+    item.depth = depth;
+
+    PQShard *shard = &state->shards[psssRand(rng) % state->nShards];
+    {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        shard->push(item);
+    }
+
+    if (live)
+        state->nodes[id]++;
+}
+
+// pop an item from the better of two random shards and mark the worker as busy with it
+bool psssPop(ParallelSSSState *state, int id, unsigned *rng, ListItem *item)
+{
+    PQShard *s1 = &state->shards[psssRand(rng) % state->nShards];
+    PQShard *s2 = &state->shards[psssRand(rng) % state->nShards];
+    PQShard *shard = (s2->top > s1->top) ? s2 : s1;
+
+    std::lock_guard<std::mutex> guard(shard->lock);
+    if (shard->empty())
+        return false;
+
+    // publish what we are working on before the item disappears from the shard
+    state->inflight[id] = shard->top.load();
+    state->seq[id]++;
+    *item = shard->pop();
+    return true;
+}
+
+void psssFinish(ParallelSSSState *state, int id)
+{
+    state->seq[id]++;
+}
+
+// true if some ancestor of the node was closed (i.e, the item was purged)
+bool psssIsPurged(ParallelSSSState *state, Node *node)
+{
+    for (Node *cur = node->parent; cur; cur = cur->parent)
+        if (state->closed[cur->id].load(std::memory_order_acquire))
+            return true;
+
+    return false;
+}
+
+// true if nothing in OPEN (including items being worked on by other workers) has a higher merit.
+// Looks until it gets a snapshot no other worker changed meanwhile, yielding between tries
+bool psssIsGlobalMax(ParallelSSSState *state, int id, Score merit)
+{
+    unsigned seq[MAX_THREADS];
+
+    for (;;)
+    {
+        Score bound = -INF;
+        for (int t = 0; t < state->nThreads; t++)
+        {
+            seq[t] = state->seq[t];
+            if (t != id && (seq[t] & 1))
+                bound = max(bound, state->inflight[t].load());
+        }
+
+        for (int s = 0; s < state->nShards; s++)
+            bound = max(bound, state->shards[s].top.load());
+
+        // retry if any other worker picked up or finished an item while we were looking
+        bool stable = true;
+        for (int t = 0; t < state->nThreads; t++)
+            if (t != id && state->seq[t] != seq[t])
+                stable = false;
+
+        if (stable)
+            return merit >= bound;
+
+        if (state->done)
+            return false;
+        std::this_thread::yield();
+    }
+}
+
+// mark a MAX node solved. Returns false if some other worker already did
+bool psssClose(ParallelSSSState *state, Node *node)
+{
+    return !state->closed[node->id].exchange(1, std::memory_order_acq_rel);
+}
+
+void parallelSSSWorker(ParallelSSSState *state, int id)
+{
+    TRACE_SCOPE("parallel SSS* worker");
+    unsigned rng = 2463534242u + id * 7919;
+    int depth = state->depth;
+    ListItem item;
+    budgetThreadStart();
+
+    while (!state->done)
+    {
+        if (gBudget && budgetTick(1))
+            break;
+
+        if (!psssPop(state, id, &rng, &item))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        if (psssIsPurged(state, item.node))
+        {
+            psssFinish(state, id);
+            continue;
+        }
+
+        Node *node = item.node;
+        if (item.live)
+        {
+            if (item.depth == depth)    // leaf
+            {
+                psssPush(state, id, &rng, node, false, min(item.merit, evaluateLeaf(node)), item.depth);
+            }
+            else if (item.depth % 2 == 1)   // min node
+            {
+                nodeState(node)->nChildsExplored = 1;
+                psssPush(state, id, &rng, &node->children[0], true, item.merit, item.depth + 1);
+            }
+            else    // max node
+            {
+                nodeState(node)->nChildsExplored = node->nChildren;
+                for (int j = 0; j < node->nChildren; j++)
+                    psssPush(state, id, &rng, &node->children[j], true, item.merit, item.depth + 1);
+            }
+        }
+        else    // solved
+        {
+            Node *parent = node->parent;
+            if (item.depth % 2 == 1)   // min node
+            {
+                if (!psssIsGlobalMax(state, id, item.merit))
+                {
+                    // not safe to purge yet, put it back and let the workers ahead of it run first
+                    psssPush(state, id, &rng, node, false, item.merit, item.depth);
+                    psssFinish(state, id);
+                    std::this_thread::yield();
+                    continue;
+                }
+                else if (psssClose(state, parent))
+                {
+                    if (item.depth == 1)
+                    {
+                        nodeState(parent)->bestChild = (ChildIndex) (node - parent->children);
+                        state->result = item.merit;
+                        state->done = true;
+                    }
+                    else
+                    {
+                        psssPush(state, id, &rng, parent, false, item.merit, item.depth - 1);
+                    }
+                }
+            }
+            else    // max node
+            {
+                if (nodeState(parent)->nChildsExplored != parent->nChildren)
+                {   // if node has unexplored brother, explore it
+                    psssPush(state, id, &rng, &parent->children[nodeState(parent)->nChildsExplored++], true, item.merit, item.depth);
+                }
+                else
+                {
+                    psssPush(state, id, &rng, parent, false, item.merit, item.depth - 1);
+                }
+            }
+        }
+
+        psssFinish(state, id);
+    }
+}
+
+Score parallelSSS_star(Node *node, int depth, int nThreads)
+{
+    TRACE_SCOPE("parallelSSS_star");
+    ParallelSSSState *state = new ParallelSSSState();
+    state->nThreads = nThreads;
+    state->nShards = nThreads * PSSS_SHARDS_PER_THREAD;
+    state->root = node;
+    state->depth = depth;
+    state->done = false;
+    state->result = 0;
+    state->closed = new std::atomic<unsigned char>[gTotalNodes]();
+    for (int t = 0; t < nThreads; t++)
+    {
+        state->inflight[t] = -INF;
+        state->seq[t] = 0;
+        state->nodes[t] = 0;
+    }
+
+    unsigned rng = 1;
+    nodeState(node)->nChildsExplored = 0;
+    psssPush(state, 0, &rng, node, true, INF, 0);
+
+    std::thread workers[MAX_THREADS];
+    for (int t = 0; t < nThreads; t++)
+        workers[t] = searchThread(parallelSSSWorker, state, t);
+    for (int t = 0; t < nThreads; t++)
+        workers[t].join();
+
+    g_psssNodes = 0;
+    for (int t = 0; t < nThreads; t++)
+        g_psssNodes += state->nodes[t];
+
+    if (!state->done)
+    {
+        // stopped by the search budget: the best merit in OPEN is an upper bound on the root value,
+        // report the root child it came from as the best move
+        Score bound = -INF;
+        Node *best = NULL;
+        for (int s = 0; s < state->nShards; s++)
+        {
+            for (int i = 0; i < state->shards[s].size(); i++)
+            {
+                ListItem *item = state->shards[s].item(i);
+                if (item->merit > bound && !psssIsPurged(state, item->node))
+                {
+                    bound = item->merit;
+                    best = item->node;
+                }
+            }
+        }
+
+        while (best && best != node && best->parent != node)
+            best = best->parent;
+        if (best && best != node)
+            nodeState(node)->bestChild = (ChildIndex) (best - node->children);
+        state->result = bound;
+    }
+
+    Score val = state->result;
+    nodeState(node)->nodeVal = val;
+    delete[] state->closed;
+    delete state;
+    return val;
+}
+
+// anytime version, the value is an upper bound if the search was stopped
+SearchResult parallelSSS_starAnytime(Node *node, int depth, int nThreads, const SearchBudget *budget)
+{
+    SearchResult result;
+    START_TIMER
+    startBudget(budget);
+    result.value = parallelSSS_star(node, depth, nThreads);
+    result.completed = !endBudget();
+    result.bestChild = nodeState(node)->bestChild;
+    result.nodes = g_psssNodes;
+    STOP_TIMER
+    result.time = gTime;
+
+    return result;
+}
+
+
+
+// Parallel Monte Carlo Tree Search
+//
+// UCT over the same trees, a throughput oriented engine to compare with the alpha-beta family. A playout
+// walks down from the root choosing children by UCT as long as they have statistics, expands the first node
+// that doesn't, and from there descends to a random leaf whose value is the playout result.
+// The statistics are kept in MCTSStats arrays alongside the nodes' children arrays, allocated when a node is
+// expanded and only updated with atomics, so any number of threads run playouts at the same time. A thread
+// adds a virtual loss to every node on its path until its result is backed up, which steers the other
+// threads to different lines meanwhile. The answer is the most visited root child, and the value the mean
+// playout result through it (an estimate, not a bound).
+// A leaf the tree grows to has an exact value, and the tree keeps a lower bound for every node from those: the
+// largest of the children's at a max node, the smallest at a min node (so none until all children have one).
+// The root's is the bound the anytime version reports.
+
+#define MCTS_EXPLORATION  0.7f
+#define MCTS_VIRTUAL_LOSS 1
+#define MCTS_MAX_PLAYOUTS (1 << 30)     // for the anytime version, which is stopped by the budget
+
+struct MCTSStats
+{
+    std::atomic<int>         visits;
+    std::atomic<int>         virtualLoss;
+    std::atomic<long long>   valueSum;  // playout results in hundredths, from the point of view of the player choosing this node
+    std::atomic<Score>       lowerBound;    // on the node's value (from the root's point of view), -INF if none yet
+    std::atomic<MCTSStats *> children;  // for the node's children, NULL until the node is expanded
+};
+
+struct MCTSState
+{
+    Node *root;
+    int depth;
+    MCTSStats rootStats;
+    std::atomic<int> playoutsLeft;
+    std::atomic<int> playouts;
+    std::atomic<int> nodes;
+};
+
+int gMCTSPlayouts = 0;
+int gMCTSNodes = 0;
+Score gMCTSLowerBound = -INF;    // of the root value, after the last search
+
+void initMCTSStats(MCTSStats *stats)
+{
+    stats->visits = 0;
+    stats->virtualLoss = 0;
+    stats->valueSum = 0;
+    stats->lowerBound = -INF;
+    stats->children = NULL;
+}
+
+// returns the children's stats, allocated by this thread or by one that got there first
+MCTSStats *mctsExpand(MCTSStats *stats, int nChildren)
+{
+    MCTSStats *children = new MCTSStats[nChildren];
+    for (int i = 0; i < nChildren; i++)
+        initMCTSStats(&children[i]);
+
+    MCTSStats *expected = NULL;
+    if (!stats->children.compare_exchange_strong(expected, children))
+    {
+        delete [] children;
+        return expected;
+    }
+    return children;
+}
+
+int mctsSelect(MCTSStats *stats, MCTSStats *children, int nChildren)
+{
+    float logN = logf((float) (stats->visits + stats->virtualLoss + 1));
+    int best = 0;
+    float bestUCT = -1.0f;
+
+    for (int i = 0; i < nChildren; i++)
+    {
+        // virtual losses count as visits that scored nothing
+        int n = children[i].visits + children[i].virtualLoss;
+        if (n == 0)
+            return i;
+
+        float q = children[i].valueSum / (10000.0f * n);
+        float uct = q + MCTS_EXPLORATION * sqrtf(logN / n);
+        if (uct > bestUCT)
+        {
+            bestUCT = uct;
+            best = i;
+        }
+    }
+
+    return best;
+}
+
+void freeMCTSStats(MCTSStats *stats, Node *node)
+{
+    MCTSStats *children = stats->children;
+    if (!children)
+        return;
+
+    for (int i = 0; i < node->nChildren; i++)
+        freeMCTSStats(&children[i], &node->children[i]);
+    delete [] children;
+}
+
+// raises the bound to 'value', false if it already was at least that
+bool raiseBound(std::atomic<Score> *bound, Score value)
+{
+    Score old = *bound;
+    while (old < value)
+    {
+        if (bound->compare_exchange_weak(old, value))
+            return true;
+    }
+    return false;
+}
+
+// backs the value of the leaf at the end of the path up the lower bounds, as far as they change
+void mctsBackUpBound(MCTSState *state, Node **choosers, MCTSStats **path, int length, Score leafVal)
+{
+    if (!raiseBound(&path[length - 1]->lowerBound, leafVal))
+        return;
+
+    for (int i = length - 1; i >= 0; i--)
+    {
+        Node *node = choosers[i];
+        MCTSStats *stats = i ? path[i - 1] : &state->rootStats;
+        MCTSStats *children = stats->children;
+        Score bound = children[0].lowerBound;
+        for (int c = 1; c < node->nChildren; c++)
+            bound = node->isMaxNode ? max(bound, children[c].lowerBound.load()) : min(bound, children[c].lowerBound.load());
+
+        if (!raiseBound(&stats->lowerBound, bound))
+            return;
+    }
+}
+
+void mctsWorker(MCTSState *state, int t)
+{
+    TRACE_SCOPE("MCTS worker");
+    budgetThreadStart();
+    unsigned rng = 0x9E3779B9u * (t + 1);
+
+    Node *choosers[MAX_DEPTH];
+    MCTSStats *path[MAX_DEPTH];
+    int nodes = 0;
+
+    while (state->playoutsLeft-- > 0)
+    {
+        if (gBudget && budgetTick(state->depth + 1))
+            break;
+
+        // selection and expansion
+        Node *node = state->root;
+        MCTSStats *stats = &state->rootStats;
+        int length = 0;
+        while (length < state->depth)
+        {
+            MCTSStats *children = stats->children;
+            bool expanded = children != NULL;
+            if (!expanded)
+                children = mctsExpand(stats, node->nChildren);
+
+            int c = mctsSelect(stats, children, node->nChildren);
+            choosers[length] = node;
+            node = &node->children[c];
+            stats = &children[c];
+            stats->virtualLoss += MCTS_VIRTUAL_LOSS;
+            path[length++] = stats;
+
+            if (!expanded)
+                break;
+        }
+
+        // random playout to a leaf
+        Node *leaf = node;
+        for (int d = length; d < state->depth; d++)
+            leaf = &leaf->children[psssRand(&rng) % leaf->nChildren];
+        nodes += state->depth + 1;
+
+        Score leafVal = evaluateLeaf(leaf);
+        int result = (int) (scoreToFloat(leafVal) * 100.0f + 0.5f);
+        if (length == state->depth)
+            mctsBackUpBound(state, choosers, path, length, leafVal);
+
+        // back up
+        state->rootStats.visits++;
+        for (int i = 0; i < length; i++)
+        {
+            path[i]->valueSum += choosers[i]->isMaxNode ? result : 10000 - result;
+            path[i]->visits++;
+            path[i]->virtualLoss -= MCTS_VIRTUAL_LOSS;
+        }
+        state->playouts++;
+    }
+
+    state->nodes += nodes;
+}
+
+Score parallelMCTS(Node *root, int depth, int nThreads, int playouts)
+{
+    TRACE_SCOPE("parallelMCTS");
+    MCTSState *state = new MCTSState();
+    state->root = root;
+    state->depth = depth;
+    initMCTSStats(&state->rootStats);
+    state->playoutsLeft = playouts;
+    state->playouts = 0;
+    state->nodes = 0;
+
+    std::thread workers[MAX_THREADS];
+    for (int t = 0; t < nThreads; t++)
+        workers[t] = std::thread(mctsWorker, state, t);
+    for (int t = 0; t < nThreads; t++)
+        workers[t].join();
+
+    Score val = 0;
+    MCTSStats *children = state->rootStats.children;
+    if (children)
+    {
+        int best = 0;
+        for (int i = 1; i < root->nChildren; i++)
+            if (children[i].visits > children[best].visits)
+                best = i;
+
+        nodeState(root)->bestChild = best;
+        if (children[best].visits)
+            val = scoreFromHundredths(children[best].valueSum / children[best].visits);
+    }
+    nodeState(root)->nodeVal = val;
+
+    gMCTSPlayouts = state->playouts;
+    gMCTSNodes = state->nodes;
+    gMCTSLowerBound = state->rootStats.lowerBound;
+    freeMCTSStats(&state->rootStats, root);
+    delete state;
+    return val;
+}
+
+// anytime version: runs playouts until the budget is exhausted and reports the lower bound on the root value,
+// 'completed' is always false
+SearchResult parallelMCTSAnytime(Node *node, int depth, int nThreads, const SearchBudget *budget)
+{
+    SearchResult result;
+    START_TIMER
+    startBudget(budget);
+    parallelMCTS(node, depth, nThreads, MCTS_MAX_PLAYOUTS);
+    endBudget();
+    result.value = gMCTSLowerBound;
+    result.completed = false;
+    result.bestChild = nodeState(node)->bestChild;
+    result.nodes = gMCTSNodes;
+    STOP_TIMER
+    result.time = gTime;
+
+    return result;
+}
+
+
+// Portfolio racing
+//
+// Which engine is fastest depends on the tree, so a portfolio search runs several of them on the same tree at
+// once, each on a thread of its own with a search state of its own, and takes the result of the first one to
+// finish. That one sets gSearchStopped, and the others stop at their next budget check as if their budget had
+// run out. They all run under the one budget of the race: its node limit is for all of them together. The
+// winner is recorded per tree shape (depth and branching factor), and with fewer threads than engines only
+// the engines that won most often on trees of the same shape are raced.
+
+#define PORTFOLIO_ALPHABETA    0
+#define PORTFOLIO_EXPLORE_TREE 1
+#define PORTFOLIO_SSS_STAR     2
+#define PORTFOLIO_ENGINES      3
+#define PORTFOLIO_SHAPES       16   // branching factors by powers of two
+
+const char *gPortfolioEngineNames[PORTFOLIO_ENGINES] = { "alpha-beta", "explore tree", "SSS*" };
+int gPortfolioWins[MAX_DEPTH + 1][PORTFOLIO_SHAPES][PORTFOLIO_ENGINES];
+
+struct PortfolioRacer
+{
+    int engine;
+    SearchResult result;    // time is from the start of the race
+    NodeState *states;      // the racer's search state
+};
+
+struct PortfolioState
+{
+    Node *root;
+    int depth;
+    PortfolioRacer racers[PORTFOLIO_ENGINES];
+    std::atomic<int> winner;    // racer index, -1 while none has finished
+};
+
+// log2 of the average branching factor of the first two plies
+int treeShape(Node *root)
+{
+    int nodes = 1, children = root->nChildren;
+    for (int i = 0; i < root->nChildren; i++)
+    {
+        if (root->children[i].children)
+        {
+            nodes++;
+            children += root->children[i].nChildren;
+        }
+    }
+
+    int branching = children / nodes, shape = 0;
+    while (branching >= (2 << shape) && shape < PORTFOLIO_SHAPES - 1)
+        shape++;
+    return shape;
+}
+
+void portfolioRacer(PortfolioState *state, int r)
+{
+    PortfolioRacer *racer = &state->racers[r];
+    Node *root = state->root;
+    newSearchState();
+    budgetThreadStart();
+
+    SearchResult *result = &racer->result;
+    switch (racer->engine)
+    {
+        case PORTFOLIO_ALPHABETA:
+            result->value = alphabetaRootChildren(root, state->depth, &result->bestChild);
+            break;
+        case PORTFOLIO_EXPLORE_TREE:
+            result->value = exploreTree(root, state->depth, 1);
+            result->bestChild = (int) (nodeState(root)->best - root->children);
+            break;
+        case PORTFOLIO_SSS_STAR:
+            result->value = SSS_star(root, state->depth);
+            result->bestChild = nodeState(root)->bestChild;
+            break;
+    }
+
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    result->time = ((double) (now.QuadPart - gBudgetStart.QuadPart) * 1000.0) / gBudgetFreq.QuadPart;
+    budgetThreadEnd();
+
+    // the first one to finish wins and stops the others
+    int none = -1;
+    result->completed = !gSearchStopped;
+    if (result->completed && state->winner.compare_exchange_strong(none, r))
+        gSearchStopped = true;
+
+    racer->states = gNodeStates;
+    gNodeStates = NULL;
+}
+
+// races the engines on the tree, returns the result of the first one to finish and its search state becomes the
+// caller's. *winner gets the engine that won, -1 if the budget stopped all of them. In that case the result is
+// alpha-beta's as with alphabetaAnytime() (the first racer's if alpha-beta didn't race). The nodes are the
+// ones visited by all the engines together. Up to nThreads engines race, each on one thread
+SearchResult portfolioSearch(Node *root, int depth, int nThreads, const SearchBudget *budget, int *winner)
+{
+    TRACE_SCOPE("portfolioSearch");
+    PortfolioState *state = new PortfolioState();
+    state->root = root;
+    state->depth = depth;
+    state->winner = -1;
+
+    // fewer threads than engines: the ones that won most often on this shape, alpha-beta first on a tie
+    int shape = treeShape(root);
+    int *wins = gPortfolioWins[depth][shape];
+    int order[PORTFOLIO_ENGINES];
+    for (int e = 0; e < PORTFOLIO_ENGINES; e++)
+    {
+        int k = e;
+        for (; k > 0 && wins[order[k - 1]] < wins[e]; k--)
+            order[k] = order[k - 1];
+        order[k] = e;
+    }
+
+    int nRacers = min(max(nThreads, 1), PORTFOLIO_ENGINES);
+    for (int r = 0; r < nRacers; r++)
+    {
+        state->racers[r].engine = order[r];
+        state->racers[r].result.completed = false;
+    }
+
+    SearchBudget unlimited = { 0 };
+    startBudget(budget ? budget : &unlimited);
+
+    std::thread racers[PORTFOLIO_ENGINES];
+    for (int r = 0; r < nRacers; r++)
+        racers[r] = std::thread(portfolioRacer, state, r);
+    for (int r = 0; r < nRacers; r++)
+        racers[r].join();
+
+    int nodes = gBudgetNodes;
+    endBudget();
+
+    int w = state->winner;
+    int taken = w;
+    for (int r = 0; taken < 0 && r < nRacers; r++)
+    {
+        if (state->racers[r].engine == PORTFOLIO_ALPHABETA)
+            taken = r;
+    }
+    if (taken < 0)
+        taken = 0;
+
+    SearchResult result = state->racers[taken].result;
+    result.nodes = nodes;
+    free(gNodeStates);
+    gNodeStates = state->racers[taken].states;
+    for (int r = 0; r < nRacers; r++)
+    {
+        if (r != taken)
+            free(state->racers[r].states);
+    }
+
+    if (w >= 0)
+    {
+        nodeState(root)->nodeVal = result.value;
+        nodeState(root)->bestChild = result.bestChild;
+        gPortfolioWins[depth][shape][state->racers[w].engine]++;
+    }
+
+    *winner = w >= 0 ? state->racers[w].engine : -1;
+    delete state;
+    return result;
+}
+
+void printPortfolioWins()
+{
+    printf("portfolio wins per tree shape (depth, branching factor):\n");
+    for (int d = 0; d <= MAX_DEPTH; d++)
+    {
+        for (int s = 0; s < PORTFOLIO_SHAPES; s++)
+        {
+            int *wins = gPortfolioWins[d][s], total = 0;
+            for (int e = 0; e < PORTFOLIO_ENGINES; e++)
+                total += wins[e];
+            if (!total)
+                continue;
+
+            printf("  depth %2d, branching %5d - %5d:", d, 1 << s, (2 << s) - 1);
+            for (int e = 0; e < PORTFOLIO_ENGINES; e++)
+                printf(" %s %d", gPortfolioEngineNames[e], wins[e]);
+            printf("\n");
+        }
+    }
+}
+
+
+
+// Multi-process search
+//
+// The tree is flattened into a shared memory segment: children of a node are contiguous and referenced
+// by index, so the segment can be mapped at any address (or shipped to another host as is). The worker
+// processes (this exe started with --worker <name>) are started once and talk to the coordinator over
+// their stdin/stdout pipes; every tree goes in a new segment <name>_<n> that they are told to map.
+// The coordinator searches the first root child itself to get a bound, then hands out the remaining root
+// children to the workers.
+// Whenever the root bound improves it is broadcast to the busy workers, which use it to narrow the
+// windows of the nodes they visit from then on. Messages are fixed size and hold no pointers so the same
+// protocol can be carried over sockets. If a worker dies the coordinator searches its root child itself.
+// A worker signals the event <name>_result after writing a result, the coordinator blocks on it and on the
+// busy workers' process handles (for the ones that die) when there is nothing to read.
+
+#define MAX_PROCESSES (MAXIMUM_WAIT_OBJECTS - 1)    // the result event is waited on with their handles
+#define SHARED_TREE_MAGIC 0x54524545    // 'TREE'
+
+struct FlatNode
+{
+    Score nodeVal;
+    int   firstChild;       // index of the first child, all children are contiguous
+    int   nChildren;
+};
+
+struct SharedTreeHeader
+{
+    int magic;
+    int nNodes;
+    int depth;
+    int leafCostModel;      // the coordinator's, see setLeafCost()
+    int leafCostAmount;
+    // followed by nNodes FlatNodes, root first
+};
+
+#define MSG_SEARCH 1    // coordinator -> worker: search root child 'child', root bound is 'bound'
+#define MSG_BOUND  2    // coordinator -> worker: root bound improved to 'bound'
+#define MSG_RESULT 3    // worker -> coordinator: 'score' of root child 'child', 'nodes' visited
+#define MSG_QUIT   4    // coordinator -> worker
+#define MSG_TREE   5    // coordinator -> worker: map segment number 'child' instead of the previous one,
+                        // the worker sends it back once it has
+
+struct SearchMessage
+{
+    int   type;
+    int   child;
+    Score bound;
+    Score score;
+    int   nodes;
+};
+
+struct SearchProcess
+{
+    HANDLE process;
+    HANDLE toWorker;        // worker's stdin
+    HANDLE fromWorker;      // worker's stdout
+    int    job;             // root child being searched, -1 if idle
+    bool   alive;
+};
+
+struct MultiProcessSearch
+{
+    char   name[64];        // segments are named <name>_<n>
+    int    nSegments;
+    HANDLE resultEvent;     // <name>_result, auto-reset
+    HANDLE mapping;         // the current tree, NULL if none is loaded
+    SharedTreeHeader *header;
+    FlatNode *nodes;
+
+    SearchProcess procs[MAX_PROCESSES];
+    int nProcs;
+};
+
+int gMultiProcessNodes = 0;
+
+int countNodes(Node *node)
+{
+    int count = 1;
+    for (int i = 0; i < node->nChildren; i++)
+        count += countNodes(&node->children[i]);
+    return count;
+}
+
+// node goes at flat[index], its children are allocated starting at *next
+void flattenTree(Node *node, FlatNode *flat, int index, int *next)
+{
+    flat[index].nodeVal = node->nodeVal;
+    flat[index].nChildren = node->children ? node->nChildren : 0;
+    flat[index].firstChild = *next;
+    *next += flat[index].nChildren;
+
+    for (int i = 0; i < flat[index].nChildren; i++)
+        flattenTree(&node->children[i], flat, flat[index].firstChild + i, next);
+}
+
+bool sendMessage(HANDLE pipe, const SearchMessage *msg)
+{
+    DWORD written;
+    return WriteFile(pipe, msg, sizeof(SearchMessage), &written, NULL) && written == sizeof(SearchMessage);
+}
+
+bool readMessage(HANDLE pipe, SearchMessage *msg)
+{
+    DWORD total = 0;
+    while (total < sizeof(SearchMessage))
+    {
+        DWORD read;
+        if (!ReadFile(pipe, (char *) msg + total, sizeof(SearchMessage) - total, &read, NULL) || read == 0)
+            return false;
+        total += read;
+    }
+    return true;
+}
+
+// true if a whole message can be read without blocking. Sets *broken if the other end is gone
+bool messageAvailable(HANDLE pipe, bool *broken)
+{
+    DWORD avail = 0;
+    if (!PeekNamedPipe(pipe, NULL, 0, NULL, &avail, NULL))
+    {
+        *broken = true;
+        return false;
+    }
+    return avail >= sizeof(SearchMessage);
+}
+
+
+// alpha-beta on the flat tree, used both by the coordinator and the workers
+//
+// gRootBound is the best root value known (from the root's point of view). Raising it is the same as
+// replacing every root side value v with max(v, gRootBound) which doesn't change anything the root can
+// tell apart, so a node can narrow its window with it at any time: root side nodes (even plies) raise
+// alpha, opponent nodes (odd plies) lower beta.
+Score gRootBound = -INF;
+HANDLE gBoundPipe = NULL;   // workers poll it for MSG_BOUND every BUDGET_CHECK_INTERVAL nodes
+
+void pollRootBound()
+{
+    gBudgetCountdown = BUDGET_CHECK_INTERVAL;
+    if (!gBoundPipe)
+        return;
+
+    bool broken = false;
+    SearchMessage msg;
+    while (messageAvailable(gBoundPipe, &broken) && readMessage(gBoundPipe, &msg))
+    {
+        if (msg.type == MSG_BOUND && msg.bound > gRootBound)
+            gRootBound = msg.bound;
+    }
+}
+
+Score flatAlphabeta(const FlatNode *nodes, int index, int depth, int origDepth, Score alpha, Score beta, int ply)
+{
+    const FlatNode *node = &nodes[index];
+    if (depth == 0)
+    {
+        gLeafNodesVisited++;
+        payLeafCost(index);
+
+        // eval for even depths, -eval for odd depths
+        if (origDepth % 2 == 0)
+            return node->nodeVal;
+        else
+            return -node->nodeVal;
+    }
+
+    gInteriorNodesVisited++;
+
+    if (--gBudgetCountdown == 0)
+        pollRootBound();
+
+    if (ply & 1)
+    {
+        if (-gRootBound <= alpha)
+            return alpha;
+        beta = min(beta, -gRootBound);
+    }
+    else
+    {
+        if (gRootBound >= beta)
+            return beta;
+        alpha = max(alpha, gRootBound);
+    }
+
+    for (int i = 0; i < node->nChildren; i++)
+    {
+        Score curScore = -flatAlphabeta(nodes, node->firstChild + i, depth - 1, origDepth, -beta, -alpha, ply + 1);
+        if (curScore >= beta)
+        {
+            return beta;
+        }
+
+        if (curScore > alpha)
+        {
+            alpha = curScore;
+        }
+    }
+
+    return alpha;
+}
+
+// searches one root child of the shared tree, returns its score from the root's point of view
+Score searchSharedRootChild(SharedTreeHeader *header, FlatNode *nodes, int child, Score bound)
+{
+    TRACE_SCOPE("root child");
+    gRootBound = bound;
+    gBudgetCountdown = BUDGET_CHECK_INTERVAL;
+    gLeafNodesVisited = gInteriorNodesVisited = 0;
+
+    int depth = header->depth;
+    return -flatAlphabeta(nodes, nodes[0].firstChild + child, depth - 1, depth, -INF, -bound, 1);
+}
+
+// maps segment <name>_<segment> read only, NULL if it can't
+SharedTreeHeader *openSharedTree(const char *name, int segment, HANDLE *mapping)
+{
+    char segmentName[80];
+    sprintf(segmentName, "%s_%d", name, segment);
+    *mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, segmentName);
+    if (!*mapping)
+        return NULL;
+
+    SharedTreeHeader *header = (SharedTreeHeader *) MapViewOfFile(*mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!header || header->magic != SHARED_TREE_MAGIC)
+    {
+        if (header)
+            UnmapViewOfFile(header);
+        CloseHandle(*mapping);
+        return NULL;
+    }
+    return header;
+}
+
+// entry point of the worker processes
+int searchWorkerMain(const char *name)
+{
+    HANDLE mapping = NULL;
+    SharedTreeHeader *header = NULL;
+    FlatNode *nodes = NULL;
+
+    HANDLE in  = GetStdHandle(STD_INPUT_HANDLE);
+    HANDLE out = GetStdHandle(STD_OUTPUT_HANDLE);
+    gBoundPipe = in;
+
+    // without it the coordinator wouldn't wake up for our results, quitting hands our jobs back to it
+    char eventName[80];
+    sprintf(eventName, "%s_result", name);
+    HANDLE resultEvent = OpenEventA(EVENT_MODIFY_STATE, FALSE, eventName);
+    if (!resultEvent)
+        return 1;
+
+    SearchMessage msg;
+    while (readMessage(in, &msg))
+    {
+        if (msg.type == MSG_QUIT)
+            break;
+
+        if (msg.type == MSG_TREE)
+        {
+            if (header)
+            {
+                UnmapViewOfFile(header);
+                CloseHandle(mapping);
+            }
+
+            // if the tree can't be mapped quit, the coordinator then searches our jobs itself
+            header = openSharedTree(name, msg.child, &mapping);
+            if (!header)
+                return 1;
+            nodes = (FlatNode *) (header + 1);
+            setLeafCost(header->leafCostModel, header->leafCostAmount);
+            if (!sendMessage(out, &msg))
+                break;
+            continue;
+        }
+
+        // a MSG_BOUND here arrived after the job it was meant for finished. It's not kept for the next
+        // job, whose MSG_SEARCH carries the coordinator's bound (which is at least as high) anyway and
+        // may be for another search
+        if (msg.type == MSG_SEARCH && header)
+        {
+            SearchMessage result = { 0 };
+            result.type = MSG_RESULT;
+            result.child = msg.child;
+            result.score = searchSharedRootChild(header, nodes, msg.child, msg.bound);
+            result.nodes = gLeafNodesVisited + gInteriorNodesVisited;
+            if (!sendMessage(out, &result))
+                break;
+            SetEvent(resultEvent);
+        }
+    }
+
+    if (header)
+    {
+        UnmapViewOfFile(header);
+        CloseHandle(mapping);
+    }
+    CloseHandle(resultEvent);
+    return 0;
+}
+
+bool spawnSearchProcess(SearchProcess *proc, const char *name)
+{
+    SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
+    HANDLE childIn, childOut;
+
+    if (!CreatePipe(&childIn, &proc->toWorker, &sa, 0))
+        return false;
+    if (!CreatePipe(&proc->fromWorker, &childOut, &sa, 0))
+    {
+        CloseHandle(childIn);
+        CloseHandle(proc->toWorker);
+        return false;
+    }
+
+    // only the worker's ends are inherited
+    SetHandleInformation(proc->toWorker, HANDLE_FLAG_INHERIT, 0);
+    SetHandleInformation(proc->fromWorker, HANDLE_FLAG_INHERIT, 0);
+
+    char exe[MAX_PATH];
+    char cmdLine[MAX_PATH + 128];
+    GetModuleFileNameA(NULL, exe, MAX_PATH);
+    sprintf(cmdLine, "\"%s\" --worker %s", exe, name);
+
+    STARTUPINFOA si = { 0 };
+    si.cb = sizeof(si);
+    si.dwFlags = STARTF_USESTDHANDLES;
+    si.hStdInput = childIn;
+    si.hStdOutput = childOut;
+    si.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+
+    PROCESS_INFORMATION pi;
+    BOOL ok = CreateProcessA(NULL, cmdLine, NULL, NULL, TRUE, 0, NULL, NULL, &si, &pi);
+    CloseHandle(childIn);
+    CloseHandle(childOut);
+    if (!ok)
+    {
+        CloseHandle(proc->toWorker);
+        CloseHandle(proc->fromWorker);
+        return false;
+    }
+
+    CloseHandle(pi.hThread);
+    proc->process = pi.hProcess;
+    proc->job = -1;
+    proc->alive = true;
+    return true;
+}
+
+// starts the worker processes, load a tree with loadMultiProcessTree() before searching.
+// Returns NULL if it can't be allocated; workers that fail to start are left out
+MultiProcessSearch *createMultiProcessSearch(int nProcs)
+{
+    MultiProcessSearch *mps = (MultiProcessSearch *) malloc(sizeof(MultiProcessSearch));
+    if (!mps)
+        return NULL;
+
+    static int instance = 0;
+    sprintf(mps->name, "TreeTest_%u_%d", (unsigned) GetCurrentProcessId(), instance++);
+    mps->nSegments = 0;
+    mps->mapping = NULL;
+    mps->header = NULL;
+    mps->nodes = NULL;
+
+    // before the workers, which open it
+    char eventName[80];
+    sprintf(eventName, "%s_result", mps->name);
+    mps->resultEvent = CreateEventA(NULL, FALSE, FALSE, eventName);
+    if (!mps->resultEvent)
+    {
+        free(mps);
+        return NULL;
+    }
+
+    mps->nProcs = 0;
+    for (int i = 0; i < min(nProcs, MAX_PROCESSES); i++)
+    {
+        if (spawnSearchProcess(&mps->procs[mps->nProcs], mps->name))
+            mps->nProcs++;
+    }
+
+    return mps;
+}
+
+void unloadMultiProcessTree(MultiProcessSearch *mps)
+{
+    if (!mps->mapping)
+        return;
+
+    UnmapViewOfFile(mps->header);
+    CloseHandle(mps->mapping);
+    mps->mapping = NULL;
+    mps->header = NULL;
+    mps->nodes = NULL;
+}
+
+// flattens the tree into a new shared memory segment and has the workers map it instead of the previous
+// one. Returns false (with no tree loaded) if the segment can't be created
+bool loadMultiProcessTree(MultiProcessSearch *mps, Node *root, int depth)
+{
+    unloadMultiProcessTree(mps);
+
+    int segment = mps->nSegments++;
+    char segmentName[80];
+    sprintf(segmentName, "%s_%d", mps->name, segment);
+
+    int nNodes = countNodes(root);
+    size_t size = sizeof(SharedTreeHeader) + nNodes * sizeof(FlatNode);
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                        (DWORD) ((unsigned long long) size >> 32), (DWORD) size, segmentName);
+    if (!mapping)
+        return false;
+
+    SharedTreeHeader *header = (SharedTreeHeader *) MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (!header)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    mps->mapping = mapping;
+    mps->header = header;
+    mps->nodes = (FlatNode *) (header + 1);
+    header->magic = SHARED_TREE_MAGIC;
+    header->nNodes = nNodes;
+    header->depth = depth;
+    header->leafCostModel = gLeafCostModel;
+    header->leafCostAmount = gLeafCostAmount;
+
+    int next = 1;
+    flattenTree(root, mps->nodes, 0, &next);
+    assert(next == nNodes);
+
+    // the segment is complete before anyone is told about it
+    SearchMessage msg = { 0 };
+    msg.type = MSG_TREE;
+    msg.child = segment;
+    for (int p = 0; p < mps->nProcs; p++)
+    {
+        SearchProcess *proc = &mps->procs[p];
+        if (proc->alive && !sendMessage(proc->toWorker, &msg))
+            proc->alive = false;
+    }
+
+    // wait until every worker has it mapped, so that unloading it later can't pull it from under one
+    for (int p = 0; p < mps->nProcs; p++)
+    {
+        SearchProcess *proc = &mps->procs[p];
+        SearchMessage ack;
+        if (proc->alive && (!readMessage(proc->fromWorker, &ack) || ack.type != MSG_TREE || ack.child != segment))
+            proc->alive = false;
+    }
+
+    return true;
+}
+
+void destroyMultiProcessSearch(MultiProcessSearch *mps)
+{
+    SearchMessage quit = { 0 };
+    quit.type = MSG_QUIT;
+    for (int i = 0; i < mps->nProcs; i++)
+    {
+        SearchProcess *proc = &mps->procs[i];
+        if (proc->alive)
+            sendMessage(proc->toWorker, &quit);
+        CloseHandle(proc->toWorker);
+        if (WaitForSingleObject(proc->process, 1000) != WAIT_OBJECT_0)
+            TerminateProcess(proc->process, 1);
+        CloseHandle(proc->fromWorker);
+        CloseHandle(proc->process);
+    }
+
+    unloadMultiProcessTree(mps);
+    CloseHandle(mps->resultEvent);
+    free(mps);
+}
+
+// search the loaded tree, writes the root value and best child back to root
+Score multiProcessSearch(MultiProcessSearch *mps, Node *root)
+{
+    TRACE_SCOPE("multiProcessSearch");
+    assert(mps->header);
+    FlatNode *nodes = mps->nodes;
+    int nChildren = nodes[0].nChildren;
+
+    // first root child in the coordinator, to get a bound
+    gBoundPipe = NULL;
+    Score alpha = searchSharedRootChild(mps->header, nodes, 0, -INF);
+    int bestChild = 0;
+    int totalNodes = 1 + gLeafNodesVisited + gInteriorNodesVisited;
+
+    int nextChild = 1;
+    int nBusy = 0;
+    while (nextChild < nChildren || nBusy)
+    {
+        bool progress = false;
+        for (int p = 0; p < mps->nProcs; p++)
+        {
+            SearchProcess *proc = &mps->procs[p];
+            if (!proc->alive)
+                continue;
+
+            // hand out work to idle workers
+            if (proc->job == -1 && nextChild < nChildren)
+            {
+                SearchMessage msg = { 0 };
+                msg.type = MSG_SEARCH;
+                msg.child = nextChild;
+                msg.bound = alpha;
+                if (sendMessage(proc->toWorker, &msg))
                 {
-                    curMax = currentNodeVals[i];
-                    // need to evaluate more siblings of this node
-                    expandNode(fullCurrentFrontier, currentNodeVals, i, curMax, NULL, ignored);
-                    nExpnded++;
+                    proc->job = nextChild++;
+                    nBusy++;
+                }
+                else
+                {
+                    proc->alive = false;
                 }
+                progress = true;
+                continue;
             }
-            else //if (expectedMore[i])
+
+            if (proc->job == -1)
+                continue;
+
+            bool broken = false;
+            SearchMessage msg;
+            if (messageAvailable(proc->fromWorker, &broken) && readMessage(proc->fromWorker, &msg))
             {
-                if (currentNodeVals[i] >= curMax)
+                assert(msg.type == MSG_RESULT && msg.child == proc->job);
+                proc->job = -1;
+                nBusy--;
+                totalNodes += msg.nodes;
+                progress = true;
+
+                if (msg.score > alpha)
                 {
-                    // reject this branch (i.e, no need to evaluate any more siblings of this node)
-                    nRejected++;
-                    ignored[i] = true;
+                    alpha = msg.score;
+                    bestChild = msg.child;
+
+                    // let the busy workers know
+                    SearchMessage bound = { 0 };
+                    bound.type = MSG_BOUND;
+                    bound.bound = alpha;
+                    for (int q = 0; q < mps->nProcs; q++)
+                        if (mps->procs[q].alive && mps->procs[q].job != -1)
+                            sendMessage(mps->procs[q].toWorker, &bound);
                 }
-                if (currentNodeVals[i] < curMin)
+            }
+            else if (broken || WaitForSingleObject(proc->process, 0) == WAIT_OBJECT_0)
+            {
+                // the worker died, search its root child here
+                int child = proc->job;
+                proc->alive = false;
+                proc->job = -1;
+                nBusy--;
+
+                Score score = searchSharedRootChild(mps->header, nodes, child, alpha);
+                totalNodes += gLeafNodesVisited + gInteriorNodesVisited;
+                if (score > alpha)
                 {
-                    curMin = currentNodeVals[i];
-                    // need to evaluate more siblings of this node
-                    expandNode(fullCurrentFrontier, currentNodeVals, i, curMin, NULL, ignored);
-                    nExpnded++;
+                    alpha = score;
+                    bestChild = child;
                 }
+                progress = true;
+            }
+        }
+
+        // no workers left, finish the search here
+        if (!nBusy && nextChild < nChildren && !progress)
+        {
+            Score score = searchSharedRootChild(mps->header, nodes, nextChild, alpha);
+            totalNodes += gLeafNodesVisited + gInteriorNodesVisited;
+            if (score > alpha)
+            {
+                alpha = score;
+                bestChild = nextChild;
             }
+            nextChild++;
+            progress = true;
+        }
+
+        // sleep until a result comes in or a busy worker dies
+        if (!progress)
+        {
+            HANDLE handles[MAX_PROCESSES + 1];
+            int nHandles = 0;
+            handles[nHandles++] = mps->resultEvent;
+            for (int p = 0; p < mps->nProcs; p++)
+                if (mps->procs[p].alive && mps->procs[p].job != -1)
+                    handles[nHandles++] = mps->procs[p].process;
+            WaitForMultipleObjects(nHandles, handles, FALSE, INFINITE);
         }
+    }
+
+    gMultiProcessNodes = totalNodes;
+    nodeState(root)->nodeVal = alpha;
+    nodeState(root)->bestChild = bestChild;
+    return alpha;
+}
+
+// changes nUpdates random leaves of a searched tree, then recomputes the root value with incrementalSearch()
+// and with a full alphabeta() re-run. Returns true if both agree
+bool benchmarkIncrementalSearch(Node *root, int depth, int nUpdates)
+{
+    Score incVal, fullVal;
+    int pv[MAX_DEPTH];
+
+    initIncrementalSearch(root, depth);
+    for (int k = 0; k < nUpdates; k++)
+        updateLeafValue(randomLeaf(root, depth), scoreFromHundredths(rand() % 10000));
+
+    START_TIMER
+    incVal = incrementalSearch(root, depth);
+    STOP_TIMER
+    double incTime = gTime;
+    int incNodes = gLeafNodesVisited + gInteriorNodesVisited;
+    int pvLength = getPV(root, depth, pv);
+
+    newSearchState();
+    gLeafNodesVisited = gInteriorNodesVisited = 0;
+    START_TIMER
+    fullVal = alphabeta(root, depth, depth, -INF, INF);
+    STOP_TIMER
+
+    printf("incremental re-search after %d leaf updates: score: %f, nodes visited: %d, time taken: %g, PV:",
+           nUpdates, scoreToFloat(incVal), incNodes, incTime);
+    for (int d = 0; d < pvLength; d++)
+        printf(" %d", pv[d]);
+    printf("\nfull alpha-beta re-search: score: %f, nodes visited: %d, time taken: %g, speedup: %.1fx\n",
+           scoreToFloat(fullVal), gLeafNodesVisited + gInteriorNodesVisited, gTime, gTime / max(incTime, 1e-6));
+
+    return incVal == fullVal;
+}
+
+// lazy SMP against the root splitting parallel alpha-beta for 1, 2, 4 .. nThreads threads, with the per thread
+// stats of the widest lazy SMP run. Returns true if every run found the root value 'exact'
+bool benchmarkLazySMP(Node *root, int depth, int nThreads, Score exact)
+{
+    Score val;
+    bool ok = true;
+    for (int n = 1; ; n = min(n * 2, nThreads))
+    {
+        START_TIMER
+        val = lazySMP(root, depth, n);
+        STOP_TIMER
+        printf("lazy SMP (%d threads) best node: %d, score: %f, nodes visited: %d, time taken: %g\n",
+               n, nodeState(root)->bestChild, scoreToFloat(val), gLazySMPNodes, gTime);
+        ok = ok && val == exact;
+
+        START_TIMER
+        val = parallelAlphabeta(root, depth, n);
+        STOP_TIMER
+        printf("parallel alpha-beta (%d threads) best node: %d, score: %f, nodes visited: %d, time taken: %g\n",
+               n, nodeState(root)->bestChild, scoreToFloat(val), gParallelABNodes, gTime);
+        ok = ok && val == exact;
+
+        if (n == nThreads)
+            break;
+    }
+
+    for (int t = 0; t < nThreads; t++)
+        printf("  lazy SMP thread %d: nodes visited: %d, table hits: %d, time: %g%s\n", t, gLazySMPStats[t].nodes,
+               gLazySMPStats[t].tableHits, gLazySMPStats[t].time, gLazySMPStats[t].finishedFirst ? ", finished first" : "");
+    return ok;
+}
+
+// batched alpha-beta against one alphabeta() per tree, on nTrees random trees of the given depth.
+// returns true if they found the same values and best children, visiting the same number of nodes
+bool benchmarkBatchedAlphabeta(int nTrees, int depth)
+{
+    int totalNodes = gTotalNodes, leafNodes = gLeafNodes;
+    NodeState *states = gNodeStates;
+    gTotalNodes = gLeafNodes = 0;
+    gNodeStates = NULL;
+    Node *roots = (Node *) calloc(nTrees, sizeof(Node));
+    Node **trees = (Node **) malloc(nTrees * sizeof(Node *));
+    for (int t = 0; t < nTrees; t++)
+    {
+        genTree(&roots[t], depth);
+        trees[t] = &roots[t];
+    }
+
+    Score *values = (Score *) malloc(nTrees * sizeof(Score));
+    Score *batched = (Score *) malloc(nTrees * sizeof(Score));
+    ChildIndex *bestChild = (ChildIndex *) malloc(nTrees * sizeof(ChildIndex));
+
+    newSearchState();
+    gLeafNodesVisited = gInteriorNodesVisited = 0;
+    START_TIMER
+    for (int t = 0; t < nTrees; t++)
+        values[t] = alphabeta(trees[t], depth, depth, -INF, INF);
+    STOP_TIMER
+    int nodes = gLeafNodesVisited + gInteriorNodesVisited;
+    printf("alpha-beta on %d trees of depth %d, nodes visited: %d, time taken: %g, searches/s: %g\n",
+           nTrees, depth, nodes, gTime, nTrees * 1000.0 / gTime);
+
+    for (int t = 0; t < nTrees; t++)
+        bestChild[t] = nodeState(&roots[t])->bestChild;
+
+    newSearchState();
+    gLeafNodesVisited = gInteriorNodesVisited = 0;
+    START_TIMER
+    batchedAlphabeta(trees, nTrees, depth, batched);
+    STOP_TIMER
+    int batchedNodes = gLeafNodesVisited + gInteriorNodesVisited;
+    printf("batched alpha-beta (%d lanes), nodes visited: %d, time taken: %g, searches/s: %g\n",
+           BATCH_LANES, batchedNodes, gTime, nTrees * 1000.0 / gTime);
+
+    bool ok = nodes == batchedNodes;
+    for (int t = 0; ok && t < nTrees; t++)
+        ok = values[t] == batched[t] && bestChild[t] == nodeState(&roots[t])->bestChild;
+
+    for (int t = 0; t < nTrees; t++)
+        freeTree(&roots[t]);
+    free(gNodeStates);
+    gNodeStates = states;
+    gTotalNodes = totalNodes;
+    gLeafNodes = leafNodes;
+    free(roots);
+    free(trees);
+    free(values);
+    free(batched);
+    free(bestChild);
+    return ok;
+}
+
+// the engines on a real game tree: gameAlphabeta() on the positions, and alphabeta(), exploreTree() and
+// SSS_star() on the tree built by genGameTree(). Returns true if they found the same value
+template <typename Position>
+bool benchmarkGame(const char *name, const Position &pos, int depth)
+{
+    int bestMove;
+    gLeafNodesVisited = gInteriorNodesVisited = 0;
+    Score gameVal;
+    START_TIMER
+    gameVal = gameAlphabeta(pos, depth, -INF, INF, &bestMove);
+    STOP_TIMER
+    printf("%s, depth %d: alpha-beta on positions best move: %d, score: %f, nodes visited: %d, time taken: %g\n",
+           name, depth, bestMove, scoreToFloat(gameVal), gLeafNodesVisited + gInteriorNodesVisited, gTime);
+
+    int totalNodes = gTotalNodes, leafNodes = gLeafNodes;
+    NodeState *states = gNodeStates;
+    gTotalNodes = gLeafNodes = 0;
+    gNodeStates = NULL;
+    Node root = {0};
+    START_TIMER
+    genGameTree(&root, pos, depth);
+    STOP_TIMER
+    printf("%s game tree: total nodes: %d, leaf nodes: %d, average branching: %g, time: %g\n", name, gTotalNodes,
+           gLeafNodes, (double) (gTotalNodes - 1) / (gTotalNodes - gLeafNodes), gTime);
+
+    newSearchState();
+    gLeafNodesVisited = gInteriorNodesVisited = 0;
+    Score abVal, etVal, sssVal;
+    START_TIMER
+    abVal = alphabeta(&root, depth, depth, -INF, INF);
+    STOP_TIMER
+    printf("alpha-beta best move: %d, score: %f, nodes visited: %d, time taken: %g\n", nodeState(&root)->bestChild,
+           scoreToFloat(abVal), gLeafNodesVisited + gInteriorNodesVisited, gTime);
+
+    newSearchState();
+    START_TIMER
+    etVal = exploreTree(&root, depth, g_numThreads);
+    STOP_TIMER
+    printf("explore tree time taken: %g\n", gTime);
+
+    newSearchState();
+    START_TIMER
+    sssVal = SSS_star(&root, depth);
+    STOP_TIMER
+    printf("SSS* score: %f, time taken: %g\n", scoreToFloat(sssVal), gTime);
+
+    freeTree(&root);
+    free(gNodeStates);
+    gNodeStates = states;
+    gTotalNodes = totalNodes;
+    gLeafNodes = leafNodes;
+    return abVal == gameVal && etVal == gameVal && sssVal == gameVal;
+}
+
+// the minimal tree below node, with negaMax()'s best children
+void countMinimalTree(Node *node, int ply, int depth, int type, TreeCounts *counts)
+{
+    counts->count[ply][type]++;
+    counts->total++;
+    if (ply == depth)
+        return;
+
+    for (int i = 0; i < node->nChildren; i++)
+    {
+        bool best = i == nodeState(node)->bestChild;
+        if (type == CUT_NODE && !best)
+            continue;
+        int childType = type == PV_NODE ? (best ? PV_NODE : CUT_NODE) : childNodeType(type, best);
+        countMinimalTree(&node->children[i], ply + 1, depth, childType, counts);
+    }
+}
+
+// the nodes the last search visited, going by nChildsExplored
+void countVisited(Node *node, int ply, int depth, int type, TreeCounts *counts)
+{
+    counts->count[ply][type]++;
+    counts->total++;
+    if (ply == depth)
+        return;
+
+    int n = min(nodeState(node)->nChildsExplored, node->nChildren);
+    for (int i = 0; i < n; i++)
+        countVisited(&node->children[i], ply + 1, depth, childNodeType(type, i == 0), counts);
+}
+
+// visited / minimal, in total and per ply and type
+void printVisitedCounts(const char *name, const TreeCounts *visited, const TreeCounts *minimal, int depth)
+{
+    printf("%s: %d nodes visited, %g x minimal tree\n", name, visited->total, (double) visited->total / minimal->total);
+    for (int p = 0; p <= depth; p++)
+    {
+        int v = visited->count[p][PV_NODE] + visited->count[p][CUT_NODE] + visited->count[p][ALL_NODE];
+        int m = minimal->count[p][PV_NODE] + minimal->count[p][CUT_NODE] + minimal->count[p][ALL_NODE];
+        printf("  ply %2d: PV %d/%d, CUT %d/%d, ALL %d/%d, %g x\n", p,
+               visited->count[p][PV_NODE], minimal->count[p][PV_NODE], visited->count[p][CUT_NODE],
+               minimal->count[p][CUT_NODE], visited->count[p][ALL_NODE], minimal->count[p][ALL_NODE], (double) v / m);
+    }
+}
+
+// the minimal tree of root, and the nodes alphabeta(), exploreTree() and SSS_star() visit compared to it.
+// exploreTree() runs on one thread, speculative expansions would be reset and not show up.
+// Returns true if the minimal tree has one PV node per ply and the three engines found negaMax()'s value
+bool analyzeMinimalTree(Node *root, int depth)
+{
+    TreeCounts minimal, visited;
+    Score val[4];
+    memset(&minimal, 0, sizeof(minimal));
+    newSearchState();
+    val[0] = negaMax(root, depth, depth);
+    countMinimalTree(root, 0, depth, PV_NODE, &minimal);
+    printf("minimal tree: %d nodes, %d leaves\n", minimal.total,
+           minimal.count[depth][PV_NODE] + minimal.count[depth][CUT_NODE] + minimal.count[depth][ALL_NODE]);
+
+    newSearchState();
+    val[1] = alphabeta(root, depth, depth, -INF, INF);
+    memset(&visited, 0, sizeof(visited));
+    countVisited(root, 0, depth, PV_NODE, &visited);
+    printVisitedCounts("alpha-beta", &visited, &minimal, depth);
+
+    newSearchState();
+    val[2] = exploreTree(root, depth, 1);
+    memset(&visited, 0, sizeof(visited));
+    countVisited(root, 0, depth, PV_NODE, &visited);
+    printVisitedCounts("explore tree", &visited, &minimal, depth);
+
+    newSearchState();
+    memset(&visited, 0, sizeof(visited));
+    gVisitCounts = &visited;
+    val[3] = SSS_star(root, depth);
+    gVisitCounts = NULL;
+    printVisitedCounts("SSS*", &visited, &minimal, depth);
+
+    bool ok = val[1] == val[0] && val[2] == val[0] && val[3] == val[0];
+    for (int p = 0; p <= depth; p++)
+        ok = ok && minimal.count[p][PV_NODE] == 1;
+    return ok;
+}
+
+
+// Result verification
+//
+// Checking an engine's result with a full alpha-beta search costs about as much as the search. verifyResult()
+// proves the claimed root value v and principal variation instead: the PV has to be a line of depth moves
+// ending in a leaf worth v, a null window search of the PV move shows that it's worth at least v and one of
+// the root that nothing is worth more. Then the root value is v and the PV move is a best move. The proof
+// searches try the PV move first along the PV, each of them needs about one side of the minimal tree (see
+// analyzeMinimalTree()). They only read the tree, so verifying doesn't touch the engine's search state.
+
+// the scores next to v, for null windows
+inline Score scoreBelow(Score v)
+{
+#if INT_SCORES
+    return v - 1;
+#else
+    return nextafterf(v, -INF);
+#endif
+}
+
+inline Score scoreAbove(Score v)
+{
+#if INT_SCORES
+    return v + 1;
+#else
+    return nextafterf(v, INF);
+#endif
+}
+
+// fail hard alpha-beta for the proofs, child pv[0] is tried first (pv is NULL off the PV)
+Score proofSearch(Node *node, int depth, int origDepth, Score alpha, Score beta, const int *pv, int *nodes)
+{
+    (*nodes)++;
+    if (depth == 0)
+    {
+        // eval for even depths, -eval for odd depths
+        if (origDepth % 2 == 0)
+            return evaluateLeaf(node);
+        else
+            return -evaluateLeaf(node);
+    }
 
-    } while (nExpnded);
+    int first = pv ? pv[0] : 0;
+    for (int i = 0; i < node->nChildren; i++)
+    {
+        // the PV move, then the others in order
+        int c = i == 0 ? first : (i <= first ? i - 1 : i);
+        Score score = -proofSearch(&node->children[c], depth - 1, origDepth, -beta, -alpha,
+                                   pv && c == first ? pv + 1 : NULL, nodes);
+        if (score >= beta)
+            return beta;
+        if (score > alpha)
+            alpha = score;
+    }
+    return alpha;
+}
 
-    printf("\nFrontier Nodes: %d, main loop iterations: %d, explore subtree count: %d", nCurr, iterations, exploreSubTreeCount);
-    printf("\nExplore Tree found value: %f\n", node->nodeVal);
+// true if the root value is 'value' and pv[0] a best move, pv being the claimed line of pvLength moves.
+// *nodes gets the nodes the proof visited
+bool verifyResult(Node *root, int depth, Score value, const int *pv, int pvLength, int *nodes)
+{
+    TRACE_SCOPE("verifyResult");
+    *nodes = 0;
 
+    // the PV leads to a leaf worth value
+    if (pvLength != depth)
+        return false;
+    Node *node = root;
+    for (int d = 0; d < depth; d++)
+    {
+        if (!node->children || pv[d] < 0 || pv[d] >= node->nChildren)
+            return false;
+        node = &node->children[pv[d]];
+    }
+    if (node->children || evaluateLeaf(node) != value)     // leaf values are for the root player
+        return false;
 
+    // the PV move is worth at least value
+    if (depth > 0 && -proofSearch(&root->children[pv[0]], depth - 1, depth, -value, -scoreBelow(value), pv + 1, nodes) < value)
+        return false;
 
-    free (fullCurrentFrontier);
-    return node->nodeVal;
+    // nothing is worth more
+    return proofSearch(root, depth, depth, value, scoreAbove(value), pv, nodes) <= value;
 }
 
-
-struct ListItem
+// engine throughput against the branching factor: for every maximum branching factor a tree of a few million
+// leaves at most (with the parity of g_depth, so that the root is a max node), and the nodes per second
+// negaMax(), alphabeta(), exploreTree() (on one thread) and SSS_star() visit in it. Widths over 255 need
+// WIDE_TREES. Returns true if all four found the same value on every tree
+bool benchmarkBranching()
 {
-    Node *node;
-    float merit;    // upper bound for live, actual value for solved
-    int   depth;    // depth of the node (used to identify leaf/root)
-    bool  live;     // true - live, false - solved
-};
+    const int widths[] = {12, 48, 192, 768, 3072};
+    const double maxLeaves = 4e6;
+    int maxChildren = gMaxChildren;
+    int totalNodes = gTotalNodes, leafNodes = gLeafNodes;
+    NodeState *states = gNodeStates;
+    gNodeStates = NULL;
+    bool ok = true;
+
+    for (int w = 0; w < (int) (sizeof(widths) / sizeof(widths[0])) && widths[w] <= MAX_BRANCHING; w++)
+    {
+        double branching = (widths[w] + 1) / 2.0;
+        int depth = 2 + g_depth % 2;
+        if (pow(branching, depth) > maxLeaves)
+            break;
+        while (pow(branching, depth + 2) <= maxLeaves)
+            depth += 2;
+
+        gMaxChildren = widths[w];
+        gTotalNodes = gLeafNodes = 0;
+        Node root = {0};
+        genTree(&root, depth);
+        printf("branching 1 - %d, depth %d, total nodes: %d, leaf nodes: %d\n", widths[w], depth, gTotalNodes, gLeafNodes);
+
+        TreeCounts visited;
+        Score val[4];
+        newSearchState();
+        START_TIMER
+        val[0] = negaMax(&root, depth, depth);
+        STOP_TIMER
+        printf("  min-max:      %9d nodes, time taken: %8g, %g Mnodes/s\n", gTotalNodes, gTime, gTotalNodes / (gTime * 1000));
 
-#define MAX_LIST_SIZE 100000
+        newSearchState();
+        START_TIMER
+        val[1] = alphabeta(&root, depth, depth, -INF, INF);
+        STOP_TIMER
+        memset(&visited, 0, sizeof(visited));
+        countVisited(&root, 0, depth, PV_NODE, &visited);
+        printf("  alpha-beta:   %9d nodes, time taken: %8g, %g Mnodes/s\n", visited.total, gTime, visited.total / (gTime * 1000));
 
+        newSearchState();
+        START_TIMER
+        val[2] = exploreTree(&root, depth, 1);
+        STOP_TIMER
+        memset(&visited, 0, sizeof(visited));
+        countVisited(&root, 0, depth, PV_NODE, &visited);
+        printf("  explore tree: %9d nodes, time taken: %8g, %g Mnodes/s\n", visited.total, gTime, visited.total / (gTime * 1000));
 
-int g_sssNodes = 0;
-class List
-{
-private:
-    // simple array based implementation. O(n) complexity for most operations
-    ListItem m_list[MAX_LIST_SIZE];
-    int n;
+        newSearchState();
+        memset(&visited, 0, sizeof(visited));
+        gVisitCounts = &visited;
+        START_TIMER
+        val[3] = SSS_star(&root, depth);
+        STOP_TIMER
+        gVisitCounts = NULL;
+        printf("  SSS*:         %9d nodes, time taken: %8g, %g Mnodes/s\n", visited.total, gTime, visited.total / (gTime * 1000));
 
-public:
-    List()
-    {
-        n = 0;
-        memset(m_list, 0, sizeof(m_list));
-    };
+        ok = ok && val[1] == val[0] && val[2] == val[0] && val[3] == val[0];
+        freeTree(&root);
+    }
 
-    void addItem(Node *node, bool live, float merit, int depth)
-    {
-        ListItem newItem;
-        newItem.live = live;
-        newItem.node = node;
-        newItem.merit = merit;
-        newItem.depth = depth;
-        m_list[n++] = newItem;
+    free(gNodeStates);
+    gNodeStates = states;
+    gMaxChildren = maxChildren;
+    gTotalNodes = totalNodes;
+    gLeafNodes = leafNodes;
+    return ok;
+}
 
-        if (live == true)
-            g_sssNodes++;
+// alpha-beta, exploreTree() (on one thread) and SSS_star() on the tree with a few leaf evaluation costs, to see
+// how their ranking changes when evaluation dominates. Returns true if the three agree under every cost model
+// (the cost must not change the values)
+bool benchmarkLeafCost(Node *root, int depth)
+{
+    const struct { int model, amount; const char *name; } costs[] = {
+        { LEAF_COST_NONE,   0,    "none" },
+        { LEAF_COST_SPIN,   100,  "spin 100" },
+        { LEAF_COST_SPIN,   1000, "spin 1000" },
+        { LEAF_COST_MEMORY, 10,   "memory 10" },
+        { LEAF_COST_MEMORY, 100,  "memory 100" },
     };
+    int model = gLeafCostModel, amount = gLeafCostAmount;
+    Score first = 0;
+    bool ok = true;
 
-
-    // return index of max node in the list
-    int findMax()
+    for (int c = 0; c < (int) (sizeof(costs) / sizeof(costs[0])); c++)
     {
-        int maxIndex = 0;
-        ListItem max = m_list[0];
-        for (int i=1; i<n; i++)
-        {
-            if (m_list[i].merit > max.merit)
-            {
-                max = m_list[i];
-                maxIndex = i;
-            }
-        }
-        
-        return maxIndex;
-    }
+        setLeafCost(costs[c].model, costs[c].amount);
+        double times[3];
+        Score val[3];
 
-    ListItem getMax()
-    {
-        return m_list[findMax()];
-    };
+        newSearchState();
+        START_TIMER
+        val[0] = alphabeta(root, depth, depth, -INF, INF);
+        STOP_TIMER
+        times[0] = gTime;
 
-    // return index of node in the list
-    int findItem(Node *node)
-    {
-        for (int i=0; i<n; i++)
-            if (m_list[i].node == node)
-                return i;
+        newSearchState();
+        START_TIMER
+        val[1] = exploreTree(root, depth, 1);
+        STOP_TIMER
+        times[1] = gTime;
 
-        // NOT FOUND
-        return -1;
+        newSearchState();
+        START_TIMER
+        val[2] = SSS_star(root, depth);
+        STOP_TIMER
+        times[2] = gTime;
+
+        if (c == 0)
+            first = val[0];
+        ok = ok && val[0] == first && val[1] == first && val[2] == first;
+
+        printf("leaf cost %-10s  time taken, alpha-beta: %8g, explore tree: %8g, SSS*: %8g\n", costs[c].name,
+               times[0], times[1], times[2]);
     }
-    
-    void deleteIndex(int index)
+
+    setLeafCost(model, amount);
+    return ok;
+}
+
+// portfolio search against alpha-beta alone on nTrees random trees for each of a few maximum branching factors,
+// of up to 100000 leaves (with the parity of g_depth). Prints the worst time of both per branching factor and
+// the wins per shape, returns true if the portfolio always found alpha-beta's value
+bool benchmarkPortfolio(int nTrees)
+{
+    const int widths[] = {4, 12, 48};
+    const double maxLeaves = 1e5;
+    int maxChildren = gMaxChildren;
+    int totalNodes = gTotalNodes, leafNodes = gLeafNodes;
+    NodeState *states = gNodeStates;
+    gNodeStates = NULL;
+    bool ok = true;
+
+    for (int w = 0; w < (int) (sizeof(widths) / sizeof(widths[0])); w++)
     {
-        if (index >= 0)
+        double branching = (widths[w] + 1) / 2.0;
+        int depth = 2 + g_depth % 2;
+        while (pow(branching, depth + 2) <= maxLeaves && depth + 2 <= MAX_DEPTH)
+            depth += 2;
+
+        gMaxChildren = widths[w];
+        double worstAB = 0, worstPortfolio = 0;
+        for (int t = 0; t < nTrees; t++)
         {
-            for (int i=index; i < n-1; i++)
-                m_list[i] = m_list[i+1];
-            n--;
+            gTotalNodes = gLeafNodes = 0;
+            Node root = {0};
+            genTree(&root, depth);
+
+            Score val;
+            newSearchState();
+            START_TIMER
+            val = alphabeta(&root, depth, depth, -INF, INF);
+            STOP_TIMER
+            worstAB = max(worstAB, gTime);
+
+            SearchResult result;
+            int winner;
+            START_TIMER
+            result = portfolioSearch(&root, depth, g_numThreads, NULL, &winner);
+            STOP_TIMER
+            worstPortfolio = max(worstPortfolio, gTime);
+
+            ok = ok && winner >= 0 && result.value == val;
+            freeTree(&root);
         }
+        printf("branching 1 - %d, depth %d, worst time of %d trees, alpha-beta: %g, portfolio: %g\n",
+               widths[w], depth, nTrees, worstAB, worstPortfolio);
     }
+    printPortfolioWins();
+
+    free(gNodeStates);
+    gNodeStates = states;
+    gMaxChildren = maxChildren;
+    gTotalNodes = totalNodes;
+    gLeafNodes = leafNodes;
+    return ok;
+}
 
-    void deleteItem(Node *node)
-    {
-        deleteIndex(findItem(node));
-    }
+// exploreTree() with the frontier on the heap and with every frontier array spilled to a file, returns true if
+// both found the same value with the same number of subtree explorations
+bool benchmarkFrontierSpill(Node *root, int depth)
+{
+    size_t spillBytes = gFrontierSpillBytes;
+    Score val[2];
+    int count[2];
+    double time[2];
 
-    ListItem extractMax()
+    for (int spill = 0; spill < 2; spill++)
     {
-        int maxIndex = findMax();
-        ListItem max = m_list[maxIndex];
-        deleteIndex(maxIndex);
-        return max;
+        gFrontierSpillBytes = spill ? 0 : ~(size_t) 0;
+        newSearchState();
+        START_TIMER
+        val[spill] = exploreTree(root, depth, g_numThreads);
+        STOP_TIMER
+        count[spill] = exploreSubTreeCount;
+        time[spill] = gTime;
     }
+    gFrontierSpillBytes = spillBytes;
 
-};
+    printf("frontier in memory: score: %f, time taken: %g, spilled to disk: score: %f, time taken: %g\n",
+           scoreToFloat(val[0]), time[0], scoreToFloat(val[1]), time[1]);
+    return val[0] == val[1] && count[0] == count[1];
+}
 
-void purgeSubTree(List *list, Node *node)
+// multi-PV against K independent searches, returns true if they found the same scores
+bool benchmarkMultiPV(Node *root, int depth, int K)
 {
-    if (node->nChildsExplored)
+    MultiPV pv, independent;
+    int line[MAX_DEPTH];
+
+    START_TIMER
+    multiPVAlphabeta(root, depth, K, &pv);
+    STOP_TIMER
+    double pvTime = gTime;
+    printf("multi-PV (K = %d) nodes visited: %d, time taken: %g\n", K, pv.nodes, pvTime);
+    for (int k = 0; k < pv.nMoves; k++)
     {
-        for (int i=0; i<node->nChildsExplored; i++)
-        {
-            purgeSubTree(list, &node->children[i]);
-        }
+        // the child's search was exact, its best children make the rest of the line
+        int length = getPV(&root->children[pv.child[k]], depth - 1, line);
+        printf("  %d. move %d, score: %f, PV:", k + 1, pv.child[k], scoreToFloat(pv.score[k]));
+        for (int d = 0; d < length; d++)
+            printf(" %d", line[d]);
+        printf("\n");
     }
 
-    node->nChildsExplored = 0;
+    START_TIMER
+    multiPVIndependent(root, depth, K, &independent);
+    STOP_TIMER
+    printf("%d independent searches nodes visited: %d, time taken: %g\n", K, independent.nodes, gTime);
 
-    list->deleteItem(node);
+    bool ok = pv.nMoves == independent.nMoves;
+    for (int k = 0; ok && k < pv.nMoves; k++)
+        ok = pv.score[k] == independent.score[k];
+    return ok;
 }
 
-float SSS_star(Node *node, int depth)
+void copyTree(Node *dst, const Node *src, Node *parent)
 {
-    List *activeNodes = new List();
+    *dst = *src;
+    dst->parent = parent;
+    if (!src->children)
+        return;
 
-    node->nChildsExplored = 0;
-    activeNodes->addItem(node, true, INF, 0);
-    
-    while(true)
+    dst->children = (Node *) malloc(src->nChildren * sizeof(Node));
+    for (int i = 0; i < src->nChildren; i++)
+        copyTree(&dst->children[i], &src->children[i], dst);
+}
+
+// plays nMoves best moves on a searched tree with advanceRoot(). After each move alpha-beta searches the reused
+// tree and a copy of it taken before the retained best children were moved first, i.e. without the warm start.
+// Returns true if both always agree
+bool benchmarkAdvanceRoot(Node *root, int depth, int nMoves)
+{
+    bool ok = true;
+    for (int m = 0; m < nMoves; m++)
     {
-        ListItem node = activeNodes->extractMax();
-        if (node.live)
-        {
-            if (node.depth == depth)    // leaf
-            {
-                activeNodes->addItem(node.node, false, min(node.merit, node.node->nodeVal), node.depth);                
-            }
-            else if (node.depth % 2 == 1)   // min node
-            {
-                activeNodes->addItem(&node.node->children[0], true, node.merit, node.depth + 1);
+        Score warmVal, coldVal;
 
-                node.node->nChildsExplored = 1;
-            }
-            else    // max node
-            {
-                for (int j=0; j<node.node->nChildren; j++)
-                    activeNodes->addItem(&node.node->children[j], true, node.merit, node.depth + 1);
+        START_TIMER
+        advanceRoot(root, nodeState(root)->bestChild, depth, false);
+        STOP_TIMER
+        double advanceTime = gTime;
 
-                node.node->nChildsExplored = node.node->nChildren;
-            }
-        }
-        else    // solved
-        {
-            if (node.depth == 0)
-            {
-                return node.merit;
-            }
-            else if (node.depth % 2 == 1)   // min node
-            {
-                // purge parent and it's all children present in the list
-                // TODO: optimize this
-                purgeSubTree(activeNodes, node.node->parent);
-                activeNodes->addItem(node.node->parent, false, node.merit, node.depth - 1);
+        Node cold;
+        copyTree(&cold, root, NULL);
+        moveBestChildrenFirst(root, depth);
 
-                if (node.depth == 1)
-                {
-                    // find the child node index for best move
-                    for (int  i=0; i<node.node->parent->nChildren; i++)
-                    {
-                        if (node.node == &node.node->parent->children[i])
-                        {
-                            node.node->parent->bestChild = i;
-                            break;
-                        }
-                    }
-                }
-            }
-            else    // max node
-            {
-                if (node.node->parent->nChildsExplored != node.node->parent->nChildren)
-                {   // if node has unexplored brother, explore it
-                    activeNodes->addItem(&node.node->parent->children[node.node->parent->nChildsExplored++], true, node.merit, node.depth);
-                }
-                else
-                {
-                    activeNodes->addItem(node.node->parent, false, node.merit, node.depth - 1);
-                }
-            }
-        }
+        gLeafNodesVisited = gInteriorNodesVisited = 0;
+        START_TIMER
+        warmVal = alphabeta(root, depth, depth, -INF, INF);
+        STOP_TIMER
+        double warmTime = gTime;
+        int warmNodes = gLeafNodesVisited + gInteriorNodesVisited;
+
+        // the copy has the same ids, but its children aren't in the same order: a state of its own
+        NodeState *states = gNodeStates;
+        gNodeStates = NULL;
+        newSearchState();
+        gLeafNodesVisited = gInteriorNodesVisited = 0;
+        START_TIMER
+        coldVal = alphabeta(&cold, depth, depth, -INF, INF);
+        STOP_TIMER
+        freeTree(&cold);
+        free(gNodeStates);
+        gNodeStates = states;
+
+        printf("move %d: advance root took %g ms, warm start score: %f, nodes visited: %d, time taken: %g, "
+               "cold: score: %f, nodes visited: %d, time taken: %g\n", m + 1, advanceTime, scoreToFloat(warmVal),
+               warmNodes, warmTime, scoreToFloat(coldVal), gLeafNodesVisited + gInteriorNodesVisited, gTime);
+
+        ok = ok && warmVal == coldVal;
     }
+    return ok;
+}
 
-    delete activeNodes;
-    return 0;
+// compares parallel alpha-beta on the same tree allocated with malloc and with genTreePlaced(), returns true if
+// both found the same value
+//
+// Windows doesn't expose the TLB miss counters to applications, so along with the wall time this reports
+// how many pages are needed to map the tree and how much of it a typical 1536 entry L2 TLB covers.
+// To measure the misses themselves run it under a profiler that samples DTLB_LOAD_MISSES (VTune, WPR).
+bool benchmarkTreePlacement(int depth, int seed, int flags)
+{
+    const int tlbEntries = 1536;
+    Node root;
+    Score val, mallocVal;
+    int totalNodes = gTotalNodes, leafNodes = gLeafNodes;
+    NodeState *states = gNodeStates;
+    gNodeStates = NULL;
+
+    printf("\ntree placement benchmark, depth %d, seed %d\n", depth, seed);
+
+    memset(&root, 0, sizeof(root));
+    gTotalNodes = gLeafNodes = 0;
+    srand(seed);
+    genTree(&root, depth);
+    double treeMB = (double) gTotalNodes * sizeof(Node) / (1024 * 1024);
+    newSearchState();
+
+    START_TIMER
+    mallocVal = parallelAlphabeta(&root, depth, g_numThreads);
+    STOP_TIMER
+    printf("malloc:                 score: %f, time taken: %g ms, %.0f 4KB pages, TLB reach %.1f%%\n",
+           scoreToFloat(mallocVal), gTime, ceil(treeMB * 256), min(100.0, tlbEntries * 4.0 / 1024 / treeMB * 100));
+    freeTree(&root);
+
+    TreePlacement placement;
+    initTreePlacement(&placement, flags);
+    memset(&root, 0, sizeof(root));
+    gTotalNodes = gLeafNodes = 0;
+    srand(seed);
+    genTreePlaced(&root, depth, &placement);
+    newSearchState();
+
+    bool largePages = true;
+    for (int n = 0; n < placement.nNodes; n++)
+        largePages = largePages && placement.arenas[n].largePages;
+    double pageKB = largePages ? GetLargePageMinimum() / 1024.0 : 4.0;
+
+    START_TIMER
+    val = parallelAlphabeta(&root, depth, g_numThreads, (flags & PLACE_NUMA) ? placement.nNodes : 0);
+    STOP_TIMER
+    printf("placed (%d NUMA nodes, %s pages): score: %f, time taken: %g ms, %.0f pages, TLB reach %.1f%%\n",
+           placement.nNodes, largePages ? "large" : "small", scoreToFloat(val), gTime, ceil(treeMB * 1024 / pageKB),
+           min(100.0, tlbEntries * pageKB / 1024 / treeMB * 100));
+    freeTreePlacement(&placement);
+
+    free(gNodeStates);
+    gNodeStates = states;
+    gTotalNodes = totalNodes;
+    gLeafNodes = leafNodes;
+    return val == mallocVal;
 }
 
+void initThreads()
+{
+    g_numThreads = std::thread::hardware_concurrency();
+    if (g_numThreads < 1)
+        g_numThreads = 1;
+    if (g_numThreads > MAX_THREADS)
+        g_numThreads = MAX_THREADS;
+}
+
+void printAnytimeResult(const char *name, SearchResult *result)
+{
+    printf("%-22s best node: %d, score: %f (%s), nodes: %d, time taken: %g\n", name, result->bestChild, scoreToFloat(result->value),
+           result->completed ? "exact" : "stopped", result->nodes, result->time);
+}
+
+// a completed search has the root value 'exact', a stopped one a bound on it from the side its engine promises:
+// below for bound < 0, above for bound > 0
+bool anytimeResultOk(const SearchResult *result, Score exact, int bound)
+{
+    if (result->completed)
+        return result->value == exact;
+    return bound < 0 ? result->value <= exact : result->value >= exact;
+}
 
-int main2()
+// runs the anytime searches under the budget and prints their results. Returns false if one of them is wrong
+// about the root value 'exact', see anytimeResultOk()
+bool printAnytimeResults(Node *root, int depth, Score exact, const SearchBudget *budget)
 {
+    SearchResult result;
+    bool ok = true;
+
+    newSearchState();
+    result = alphabetaAnytime(root, depth, budget);
+    printAnytimeResult("alpha-beta", &result);
+    ok = ok && anytimeResultOk(&result, exact, -1);
+
+    newSearchState();
+    result = exploreTreeAnytime(root, depth, budget);
+    printAnytimeResult("explore tree", &result);
+    ok = ok && anytimeResultOk(&result, exact, -1);
+
+    newSearchState();
+    result = SSS_starAnytime(root, depth, budget);
+    printAnytimeResult("SSS*", &result);
+    ok = ok && anytimeResultOk(&result, exact, 1);
+
+    newSearchState();
+    result = parallelAlphabetaAnytime(root, depth, g_numThreads, budget);
+    printAnytimeResult("parallel alpha-beta", &result);
+    ok = ok && anytimeResultOk(&result, exact, -1);
+
+    newSearchState();
+    result = parallelSSS_starAnytime(root, depth, g_numThreads, budget);
+    printAnytimeResult("parallel SSS*", &result);
+    ok = ok && anytimeResultOk(&result, exact, 1);
+
+    newSearchState();
+    result = parallelMCTSAnytime(root, depth, g_numThreads, budget);
+    printAnytimeResult("parallel MCTS", &result);
+    ok = ok && anytimeResultOk(&result, exact, -1);
+
+    return ok;
+}
+
+// the benchmarks, on one tree, run with --benchmark. The worker processes of the multi-process search are
+// only started with --benchmark --multi-process
+int main2(bool multiProcess)
+{
+    initThreads();
+    setLeafCost(LEAF_COST_MODEL, LEAF_COST_AMOUNT);
     printf("\n\nSize of node is %zd bytes\n\n", sizeof(Node));
     int randSeed = time(NULL);
     printf("Random Seed: %d\n", randSeed);
@@ -1117,44 +6198,197 @@ int main2()
 
 
 
-    float bestVal = 0;
+    Score bestVal = 0;
     // search the best move using min-max search
     printf("searching the tree using min-max\n");
+    newSearchState();
     START_TIMER
     bestVal = negaMax(&root, g_depth, g_depth);
     STOP_TIMER
-    printf ("best move %d, score: %f, time: %g\n", root.bestChild, root.nodeVal, gTime);
+    printf ("best move %d, score: %f, time: %g\n", nodeState(&root)->bestChild, scoreToFloat(nodeState(&root)->nodeVal), gTime);
+    int bestChild = nodeState(&root)->bestChild;
+
+    // the exact check of a full tree traversal, here rather than in main()'s loop
+    Score lmVal;
+    printf("searching the tree using level synchronous min-max (%d threads)\n", g_numThreads);
+    newSearchState();
+    START_TIMER
+    lmVal = levelMinimax(&root, g_depth, g_numThreads);
+    STOP_TIMER
+    printf ("best move %d, score: %f, time: %g\n", nodeState(&root)->bestChild, scoreToFloat(lmVal), gTime);
+    if (lmVal != bestVal || nodeState(&root)->bestChild != bestChild)
+        printf("\n*Mismatch found!*\n");
 
     // search the best move using alpha-beta search
     printf("searching the tree using alpha-beta\n");
+    newSearchState();
     START_TIMER
     bestVal = alphabeta(&root, g_depth, g_depth, -INF, INF);
     STOP_TIMER
     printf ("best move %d, score: %f\nnodes visited (leaves/interior/total): %d/%d/%d\n", 
-            root.bestChild, root.nodeVal, gLeafNodesVisited, gInteriorNodesVisited, gLeafNodesVisited + gInteriorNodesVisited);
+            nodeState(&root)->bestChild, scoreToFloat(nodeState(&root)->nodeVal), gLeafNodesVisited, gInteriorNodesVisited, gLeafNodesVisited + gInteriorNodesVisited);
     printf("time taken: %g\n", gTime);
+    double abTime = gTime;
+    int abNodes = gLeafNodesVisited + gInteriorNodesVisited;
 
+    Score etVal;
+    newSearchState();
     START_TIMER
-    exploreTree(&root, g_depth);
+    etVal = exploreTree(&root, g_depth, g_numThreads);
     STOP_TIMER
     printf("time taken: %g\n", gTime);    
+
+    // checking the result costs a fraction of the alpha-beta search
+    int pv[MAX_DEPTH], proofNodes;
+    bool verified;
+    START_TIMER
+    verified = verifyResult(&root, g_depth, etVal, pv, getBestPointerPV(&root, g_depth, pv), &proofNodes);
+    STOP_TIMER
+    printf("explore tree result %s, proof nodes: %d (alpha-beta: %d), time taken: %g\n", verified ? "verified" : "wrong",
+           proofNodes, abNodes, gTime);
+    if (!verified)
+        printf("\n*Mismatch found!*\n");
     
 
-    float val;
+    Score val;
+    newSearchState();
     START_TIMER
     val = SSS_star(&root, g_depth);
     STOP_TIMER
-    printf("SSS* best node: %d, score: %f, nodes explored: %d, time taken: %g\n", root.bestChild, val, g_sssNodes, gTime);
+    printf("SSS* best node: %d, score: %f, nodes explored: %d, time taken: %g\n", nodeState(&root)->bestChild, scoreToFloat(val), g_sssNodes, gTime);
+    if (val != bestVal)
+        printf("\n*Mismatch found!*\n");
+
+    newSearchState();
+    START_TIMER
+    val = parallelAlphabeta(&root, g_depth, g_numThreads);
+    STOP_TIMER
+    printf("parallel alpha-beta (%d threads) best node: %d, score: %f, nodes visited: %d, time taken: %g\n", g_numThreads, nodeState(&root)->bestChild, scoreToFloat(val), gParallelABNodes, gTime);
+    if (val != bestVal)
+        printf("\n*Mismatch found!*\n");
+
+    newSearchState();
+    START_TIMER
+    val = parallelSSS_star(&root, g_depth, g_numThreads);
+    STOP_TIMER
+    printf("parallel SSS* (%d threads) best node: %d, score: %f, nodes explored: %d, time taken: %g\n", g_numThreads, nodeState(&root)->bestChild, scoreToFloat(val), g_psssNodes, gTime);
+    if (val != bestVal)
+        printf("\n*Mismatch found!*\n");
+
+    MultiProcessSearch *mps = multiProcess ? createMultiProcessSearch(g_numThreads) : NULL;
+    if (mps && loadMultiProcessTree(mps, &root, g_depth))
+    {
+        newSearchState();
+        START_TIMER
+        val = multiProcessSearch(mps, &root);
+        STOP_TIMER
+        printf("multi-process (%d workers) best node: %d, score: %f, nodes visited: %d, time taken: %g\n", mps->nProcs, nodeState(&root)->bestChild, scoreToFloat(val), gMultiProcessNodes, gTime);
+        if (val != bestVal)
+            printf("\n*Mismatch found!*\n");
+    }
+    else
+    {
+        printf(multiProcess ? "multi-process search unavailable\n" : "multi-process search not requested\n");
+    }
+    if (mps)
+        destroyMultiProcessSearch(mps);
+
+    // as many playouts as alpha-beta visited nodes, then the exact value of the move it picked. That can't be
+    // more than the best move's
+    newSearchState();
+    START_TIMER
+    val = parallelMCTS(&root, g_depth, g_numThreads, abNodes);
+    STOP_TIMER
+    printf("parallel MCTS (%d threads) best node: %d, mean playout score: %f, playouts: %d, nodes visited: %d, time taken: %g\n",
+           g_numThreads, nodeState(&root)->bestChild, scoreToFloat(val), gMCTSPlayouts, gMCTSNodes, gTime);
+    int mctsChild = nodeState(&root)->bestChild;
+    val = -alphabeta(&root.children[mctsChild], g_depth - 1, g_depth, -INF, INF);
+    printf("exact score of the MCTS move: %f, of the best move: %f\n", scoreToFloat(val), scoreToFloat(bestVal));
+    if (mctsChild >= root.nChildren || gMCTSPlayouts != abNodes || val > bestVal)
+        printf("\n*Mismatch found!*\n");
+
+    // anytime searches, given a fraction of the alpha-beta time and node count
+    SearchBudget budget = { 0 };
+    budget.maxMicroseconds = 250.0 * abTime;
+    printf("\nanytime searches with a time budget of %g us\n", budget.maxMicroseconds);
+    if (!printAnytimeResults(&root, g_depth, bestVal, &budget))
+        printf("\n*Mismatch found!*\n");
+
+    budget.maxMicroseconds = 0;
+    budget.maxNodes = abNodes / 4;
+    printf("\nanytime searches with a budget of %d nodes\n", budget.maxNodes);
+    if (!printAnytimeResults(&root, g_depth, bestVal, &budget))
+        printf("\n*Mismatch found!*\n");
+
+    printf("\n");
+    if (!benchmarkLazySMP(&root, g_depth, g_numThreads, bestVal))
+        printf("\n*Mismatch found!*\n");
+
+    printf("\n");
+    if (!benchmarkPortfolio(8))
+        printf("\n*Mismatch found!*\n");
+
+    printf("\n");
+    if (!benchmarkBatchedAlphabeta(4096, 4))
+        printf("\n*Mismatch found!*\n");
+
+    printf("\n");
+    if (!benchmarkGame("Connect-4", connect4Start(), 7) ||
+        !benchmarkGame("Connect-4 (10 random moves)", randomGamePosition(connect4Start(), 10), 7) ||
+        !benchmarkGame("Othello", othelloStart(), 8) ||
+        !benchmarkGame("Othello (20 random moves)", randomGamePosition(othelloStart(), 20), 6))
+    {
+        printf("\n*Mismatch found!*\n");
+    }
+
+    printf("\n");
+    if (!benchmarkMultiPV(&root, g_depth, 4))
+        printf("\n*Mismatch found!*\n");
+
+    printf("\n");
+    if (!benchmarkIncrementalSearch(&root, g_depth, 4))
+        printf("\n*Mismatch found!*\n");
+
+    printf("\n");
+    if (!analyzeMinimalTree(&root, g_depth))
+        printf("\n*Mismatch found!*\n");
+
+    printf("\n");
+    if (!benchmarkLeafCost(&root, g_depth))
+        printf("\n*Mismatch found!*\n");
+
+    printf("\n");
+    if (!benchmarkFrontierSpill(&root, g_depth))
+        printf("\n*Mismatch found!*\n");
+
+    printf("\n");
+    if (!benchmarkBranching())
+        printf("\n*Mismatch found!*\n");
+    printf("\n");
+    if (!benchmarkAdvanceRoot(&root, g_depth, 4))
+        printf("\n*Mismatch found!*\n");
+
+    if (!benchmarkTreePlacement(g_depth, randSeed, PLACE_LARGE_PAGES | PLACE_NUMA))
+        printf("\n*Mismatch found!*\n");
 
     freeTree(&root);
+    writeTrace("trace.json");
     getchar();
 
     return 0;
 }
 
 
-int main()
+int main(int argc, char **argv)
 {
+    if (argc == 3 && strcmp(argv[1], "--worker") == 0)
+        return searchWorkerMain(argv[2]);
+    if (argc >= 2 && strcmp(argv[1], "--benchmark") == 0)
+        return main2(argc == 3 && strcmp(argv[2], "--multi-process") == 0);
+
+    initThreads();
+    setLeafCost(LEAF_COST_MODEL, LEAF_COST_AMOUNT);
+
     for (int i = 0; i < 1000; i++)
     {
         int randSeed = i + time(NULL);
@@ -1175,24 +6409,22 @@ int main()
         STOP_TIMER
         printf("random tree generated, total nodes: %d, leaf nodes: %d, time: %g ms\n", gTotalNodes, gLeafNodes, gTime);
 
-        float bestValAB = 0;
-        float bestValET = 0;
-        // search the best move using alpha-beta search
-        printf("searching the tree using alpha-beta\n");
+        Score bestValET;
+        newSearchState();
         START_TIMER
-            bestValAB = alphabeta(&root, g_depth, g_depth, -INF, INF);
+            bestValET = exploreTree(&root, g_depth, g_numThreads);
         STOP_TIMER
-        printf("best move %d, score: %f\nnodes visited (leaves/interior/total): %d/%d/%d\n",
-               root.bestChild, root.nodeVal, gLeafNodesVisited, gInteriorNodesVisited, gLeafNodesVisited + gInteriorNodesVisited);
         printf("time taken: %g\n", gTime);
 
-
+        // proven rather than compared with alpha-beta, the other engines are compared in main2()
+        int pv[MAX_DEPTH], proofNodes;
+        bool verifiedET;
         START_TIMER
-            bestValET = exploreTree(&root, g_depth);
+            verifiedET = verifyResult(&root, g_depth, bestValET, pv, getBestPointerPV(&root, g_depth, pv), &proofNodes);
         STOP_TIMER
-        printf("time taken: %g\n\n\n\n", gTime);
+        printf("explore tree result %s, proof nodes: %d, time taken: %g\n\n\n\n", verifiedET ? "verified" : "wrong", proofNodes, gTime);
 
-        if (bestValET != bestValAB)
+        if (!verifiedET)
         {
             printf("\n*Mismatch found!*\n");
             getchar();
@@ -1201,6 +6433,8 @@ int main()
         freeTree(&root);
         //getchar();
     }
+
+    writeTrace("trace.json");
     getchar();
 
     return 0;